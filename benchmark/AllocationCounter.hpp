@@ -0,0 +1,35 @@
+/******************************************************************************
+ * AllocationCounter.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef BENCHMARK_ALLOCATIONCOUNTER_HPP_
+#define BENCHMARK_ALLOCATIONCOUNTER_HPP_
+
+#include <cstddef>
+
+namespace logging::bench {
+
+/**
+ * @brief Returns the number of calls to the global operator new made by
+ * the benchmark process so far.
+ */
+std::size_t AllocationCount() noexcept;
+
+} /* namespace logging::bench */
+
+#endif /* BENCHMARK_ALLOCATIONCOUNTER_HPP_ */
@@ -0,0 +1,48 @@
+# Prints the text size of the call site probes in CodeSize_probe.cpp, and
+# of the logging templates they instantiate, from the nm output of the
+# probe object.  Run by the code_size target.
+#
+# Variables: NM, the nm tool, and OBJECTS, the probe objects.
+
+execute_process(
+  COMMAND ${NM} --demangle --print-size --size-sort --radix=d ${OBJECTS}
+  OUTPUT_VARIABLE symbols
+  RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "${NM} failed on ${OBJECTS}")
+endif()
+
+string(REPLACE "\n" ";" lines "${symbols}")
+set(call_sites "")
+set(templates "")
+set(call_sites_total 0)
+set(templates_total 0)
+foreach(line IN LISTS lines)
+  if(NOT line MATCHES "^[0-9]+ 0*([0-9]+) [tTwW] (.*)$")
+    continue()
+  endif()
+  set(size "${CMAKE_MATCH_1}")
+  set(symbol "${CMAKE_MATCH_2}")
+  string(REGEX REPLACE "\\(.*" "" name "${symbol}")
+  string(CONCAT long_string "std::__cxx11::basic_string<char, "
+         "std::char_traits<char>, std::allocator<char> >")
+  string(REPLACE "${long_string}" "std::string" name "${name}")
+  if(symbol MATCHES "\\[clone \\.cold\\]$")
+    string(APPEND name " (cold part)")
+  endif()
+  string(LENGTH "      ${size}" width)
+  math(EXPR skip "${width} - 6")
+  string(SUBSTRING "      ${size}" ${skip} 6 padded)
+  if(name MATCHES "code_size::Probe")
+    string(APPEND call_sites "\n${padded}  ${name}")
+    math(EXPR call_sites_total "${call_sites_total} + ${size}")
+  elseif(name MATCHES "logging::")
+    string(APPEND templates "\n${padded}  ${name}")
+    math(EXPR templates_total "${templates_total} + ${size}")
+  endif()
+endforeach()
+
+message("Bytes of code added to the caller by each call:${call_sites}")
+message("${call_sites_total} in total\n")
+message("Bytes of code of the logging functions they instantiate:${templates}")
+message("${templates_total} in total")
@@ -0,0 +1,71 @@
+/******************************************************************************
+ * CodeSize_probe.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+/* Call sites measured by the code_size target.  Each probe holds one Log
+ * call, so the size of a probe is the code a call adds to its caller.  The
+ * templates they instantiate are reported separately.
+ */
+#include <string>
+
+#include "LoggerV2/Log.hpp"
+
+using logging::kv;
+using logging::Log;
+using logging::ModuleHandle;
+using namespace logging::literals;
+
+namespace logging::code_size {
+
+[[gnu::noinline]] void ProbeNoArgs(const Log& log) { log.Info("Probe"); }
+
+[[gnu::noinline]] void ProbeInt(const Log& log, const int value) {
+  log.Info("Probe {}", value);
+}
+
+[[gnu::noinline]] void ProbeString(const Log& log, const std::string& text) {
+  log.Info("Probe {}", text);
+}
+
+[[gnu::noinline]] void ProbeMixed(const Log& log, const int value,
+                                  const double ratio,
+                                  const std::string& text) {
+  log.Warning("Probe {} {} {}", value, ratio, text);
+}
+
+[[gnu::noinline]] void ProbeModule(const Log& log, const ModuleHandle& mh,
+                                   const int value) {
+  log.Debug(mh, "Probe {}", value);
+}
+
+[[gnu::noinline]] void ProbeNative(const Log& log, const int value,
+                                   const double ratio) {
+  log.Info("Probe {} {}"_log, value, ratio);
+}
+
+[[gnu::noinline]] void ProbeCompiled(const Log& log, const int value,
+                                     const std::string& text) {
+  log.Info("Probe {} {}"_log, value, text);
+}
+
+[[gnu::noinline]] void ProbeFields(const Log& log, const int value) {
+  log.Info("Probe", kv("value", value), kv("status", "ok"));
+}
+
+} /* namespace logging::code_size */
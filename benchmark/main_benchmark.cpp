@@ -0,0 +1,77 @@
+/*******************************************************************************
+ * main_benchmark.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *******************************************************************************/
+
+/**
+ * @file benchmark/main_benchmark.cpp
+ * @brief The main benchmark file of LoggerV2
+ */
+/**
+ * @dir benchmark
+ * @brief Holds all of the source files for the benchmarks for LoggerV2
+ */
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include <benchmark/benchmark.h>
+
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+
+#include "AllocationCounter.hpp"
+#include "LoggerV2/Flags.hpp"
+
+ABSL_DECLARE_FLAG(::logging::flags::LogSink, log_sink);
+
+namespace {
+std::atomic<std::size_t> allocation_count{0};
+} /* namespace */
+
+namespace logging::bench {
+std::size_t AllocationCount() noexcept {
+  return allocation_count.load(std::memory_order_relaxed);
+}
+} /* namespace logging::bench */
+
+void* operator new(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+/**
+ * Google Benchmark main function.  Logging goes to the null sink unless
+ * --log_sink is given on the command line.
+ * @param argc
+ * @param argv
+ * @return
+ */
+int main(int argc, char** argv) {
+  ::benchmark::Initialize(&argc, argv);
+  absl::SetFlag(&FLAGS_log_sink, ::logging::flags::LogSink::kNull);
+  absl::ParseCommandLine(argc, argv);
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -0,0 +1,381 @@
+/******************************************************************************
+ * Async.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/Async.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "P7_Trace.h"
+
+#include "LoggerV2/Coalesce.hpp"
+#include "LoggerV2/Redaction.hpp"
+
+namespace logging {
+
+namespace detail::async {
+
+namespace {
+
+/** @brief Records consumed from one queue before moving to the next */
+constexpr int kConsumeBatch = 64;
+constexpr std::chrono::milliseconds kIdleSleep{1};
+
+struct Backend {
+  ~Backend();
+
+  void Run();
+  void Stop();
+
+  std::mutex mutex;
+  AsyncOptions options;
+  std::vector<std::shared_ptr<ThreadQueue>> queues;
+  /* Channels referenced by queued records.  Each holds one reference, which
+   * is released by Stop. */
+  std::set<IP7_Trace*> traces;
+  /* Counters of the queues that were removed since StartAsync */
+  AsyncStats retired{0, 0};
+  std::thread thread;
+  std::atomic<bool> running{false};
+  /* Incremented by Stop, so that threads create a new queue */
+  std::atomic<std::uint64_t> generation{0};
+};
+
+Backend& GetBackend() {
+  static Backend backend;
+  return backend;
+}
+
+struct LocalState {
+  ~LocalState() {
+    if (queue) {
+      queue->closed.store(true, std::memory_order_release);
+    }
+  }
+
+  std::shared_ptr<ThreadQueue> queue;
+  std::uint64_t generation = 0;
+  IP7_Trace* last_trace = nullptr;
+};
+
+thread_local LocalState local;
+
+void ReportDropped(ThreadQueue& queue) {
+  const std::uint64_t dropped = queue.TakeDropped();
+  if (dropped == 0) {
+    return;
+  }
+  MessageBuffer message;
+  fmt::format_to(std::back_inserter(message),
+                 "Dropped {} messages, the asynchronous queue was full",
+                 dropped);
+  TraceMessage(queue.drop_trace(), Level::WARNING, 0, nullptr,
+               CustomSourceLocation::current(), message);
+}
+
+void FormatInlineText(std::byte* args, MessageBuffer& message) {
+  const std::string_view text = ArgCursor(args).Read<std::string_view>();
+  message.append(text.data(), text.data() + text.size());
+}
+
+void DestroyInlineText(std::byte* /*args*/) {}
+
+void FormatOwnedText(std::byte* args, MessageBuffer& message) {
+  const std::string& text = *std::launder(reinterpret_cast<std::string*>(args));
+  message.append(text.data(), text.data() + text.size());
+}
+
+void DestroyOwnedText(std::byte* args) {
+  using std::string;
+  std::launder(reinterpret_cast<string*>(args))->~string();
+}
+
+Backend::~Backend() { Stop(); }
+
+void Backend::Run() {
+  std::vector<std::shared_ptr<ThreadQueue>> snapshot;
+  while (true) {
+    const bool stopping = !running.load(std::memory_order_acquire);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      const auto finished = [this](const std::shared_ptr<ThreadQueue>& queue) {
+        if (!queue->closed.load(std::memory_order_acquire) || !queue->Empty()) {
+          return false;
+        }
+        queue->streak().Flush();
+        retired.queued += queue->queued();
+        retired.dropped += queue->dropped();
+        return true;
+      };
+      queues.erase(std::remove_if(queues.begin(), queues.end(), finished),
+                   queues.end());
+      snapshot = queues;
+    }
+
+    bool busy = false;
+    for (const auto& queue : snapshot) {
+      for (int i = 0; i < kConsumeBatch && queue->Consume(); ++i) {
+        busy = true;
+      }
+      queue->streak().FlushExpired();
+      ReportDropped(*queue);
+    }
+    snapshot.clear();
+
+    if (!busy) {
+      if (stopping) {
+        return;
+      }
+      std::this_thread::sleep_for(kIdleSleep);
+    }
+  }
+}
+
+void Backend::Stop() {
+  enabled.store(false, std::memory_order_relaxed);
+  running.store(false, std::memory_order_release);
+  if (thread.joinable()) {
+    thread.join();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (const auto& queue : queues) {
+    queue->streak().Flush();
+    /* Records pushed after the final drain would refer to the channels
+     * released below. */
+    queue->DropPending();
+    retired.queued += queue->queued();
+    retired.dropped += queue->dropped();
+  }
+  queues.clear();
+  for (IP7_Trace* trace : traces) {
+    trace->Release();
+  }
+  traces.clear();
+  generation.fetch_add(1, std::memory_order_release);
+}
+
+} /* namespace */
+
+void StoreText(Record& record, std::byte* args, const std::string_view text) {
+  if (ArgCursor::Size(0, text) <= kSlotArgsSize) {
+    ArgCursor(args).Write(text);
+    record.format = &FormatInlineText;
+    record.destroy = &DestroyInlineText;
+  } else {
+    ::new (static_cast<void*>(args)) std::string(text);
+    record.format = &FormatOwnedText;
+    record.destroy = &DestroyOwnedText;
+  }
+}
+
+ThreadQueue::ThreadQueue(const std::size_t size, const OverflowPolicy policy)
+    : policy_(policy) {
+  std::uint64_t capacity = 2;
+  while (capacity < size) {
+    capacity <<= 1;
+  }
+  slots_ = std::make_unique<Slot[]>(capacity);
+  mask_ = capacity - 1;
+  for (std::uint64_t i = 0; i < capacity; ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+ThreadQueue::~ThreadQueue() { DropPending(); }
+
+bool ThreadQueue::PushText(IP7_Trace* trace, const Level level,
+                           const std::uint16_t id,
+                           const IP7_Trace::hModule module,
+                           const CustomSourceLocation& loc,
+                           const std::int64_t coalesce_window,
+                           const WrapPolicy wrap, const bool redact,
+                           const std::string_view text) {
+  bool dropped = false;
+  Slot* const slot = Claim(trace, dropped);
+  if (slot == nullptr) {
+    return dropped;
+  }
+  slot->record = Record{trace,
+                        module,
+                        loc,
+                        nullptr,
+                        nullptr,
+                        coalesce_window,
+                        id,
+                        level,
+                        redact,
+                        wrap};
+  StoreText(slot->record, slot->args, text);
+  Publish(*slot);
+  return true;
+}
+
+bool ThreadQueue::Consume() {
+  const std::uint64_t position = tail_.load(std::memory_order_acquire);
+  Slot& slot = slots_[position & mask_];
+  std::uint64_t expected = position + 1;
+  if (!slot.sequence.compare_exchange_strong(expected, kClaimed,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+    return false;
+  }
+
+  const Record& record = slot.record;
+  MessageBuffer message;
+  try {
+    record.format(slot.args, message);
+  } catch (const std::exception& e) {
+    /* The caller is gone, so report the error in place of the message. */
+    message.clear();
+    fmt::format_to(std::back_inserter(message),
+                   "Failed to format log message: {}", e.what());
+  }
+  record.destroy(slot.args);
+  if (record.redact) {
+    Redact(message);
+  }
+  if (record.coalesce_window != 0) {
+    CoalesceMessage(streak_, record.trace, record.level, record.id,
+                    record.module, record.loc, message, record.coalesce_window,
+                    record.wrap);
+  } else {
+    TraceMessage(record.trace, record.level, record.id, record.module,
+                 record.loc, message, record.wrap);
+  }
+
+  tail_.store(position + 1, std::memory_order_release);
+  slot.sequence.store(position + mask_ + 1, std::memory_order_release);
+  return true;
+}
+
+bool ThreadQueue::Empty() const noexcept {
+  return tail_.load(std::memory_order_acquire) ==
+         head_.load(std::memory_order_acquire);
+}
+
+std::uint64_t ThreadQueue::TakeDropped() noexcept {
+  const std::uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+  const std::uint64_t unreported = dropped - reported_;
+  reported_ = dropped;
+  return unreported;
+}
+
+bool ThreadQueue::DropOldest() {
+  const std::uint64_t position = tail_.load(std::memory_order_acquire);
+  Slot& slot = slots_[position & mask_];
+  std::uint64_t expected = position + 1;
+  if (!slot.sequence.compare_exchange_strong(expected, kClaimed,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+    return false;
+  }
+  Dropped(slot.record.trace);
+  slot.record.destroy(slot.args);
+  tail_.store(position + 1, std::memory_order_release);
+  slot.sequence.store(position + mask_ + 1, std::memory_order_release);
+  return true;
+}
+
+void ThreadQueue::DropPending() {
+  while (DropOldest()) {
+  }
+}
+
+void ThreadQueue::Dropped(IP7_Trace* trace) noexcept {
+  drop_trace_.store(trace, std::memory_order_relaxed);
+  dropped_.fetch_add(1, std::memory_order_release);
+}
+
+void ThreadQueue::Wait() noexcept { std::this_thread::yield(); }
+
+ThreadQueue& LocalQueue(IP7_Trace* trace) {
+  Backend& backend = GetBackend();
+  const std::uint64_t generation =
+      backend.generation.load(std::memory_order_acquire);
+  if (!local.queue || local.generation != generation) {
+    std::lock_guard<std::mutex> lock(backend.mutex);
+    if (local.queue) {
+      local.queue->closed.store(true, std::memory_order_release);
+    }
+    local.queue = std::make_shared<ThreadQueue>(backend.options.queue_size,
+                                                backend.options.policy);
+    local.generation = generation;
+    local.last_trace = nullptr;
+    backend.queues.push_back(local.queue);
+  }
+  if (trace != local.last_trace) {
+    std::lock_guard<std::mutex> lock(backend.mutex);
+    if (backend.traces.insert(trace).second) {
+      trace->Add_Ref();
+    }
+    local.last_trace = trace;
+  }
+  return *local.queue;
+}
+
+bool EnqueueText(IP7_Trace* trace, const Level level, const std::uint16_t id,
+                 const IP7_Trace::hModule module,
+                 const CustomSourceLocation& loc,
+                 const std::int64_t coalesce_window, const WrapPolicy wrap,
+                 const bool redact, const std::string_view text) {
+  return LocalQueue(trace).PushText(trace, level, id, module, loc,
+                                    coalesce_window, wrap, redact, text);
+}
+
+} /* namespace detail::async */
+
+void StartAsync(const AsyncOptions& options) {
+  detail::async::Backend& backend = detail::async::GetBackend();
+  backend.Stop();
+  {
+    std::lock_guard<std::mutex> lock(backend.mutex);
+    backend.options = options;
+    backend.retired = AsyncStats{0, 0};
+  }
+  backend.running.store(true, std::memory_order_release);
+  backend.thread = std::thread(&detail::async::Backend::Run, &backend);
+  detail::async::enabled.store(true, std::memory_order_relaxed);
+}
+
+void StopAsync() { detail::async::GetBackend().Stop(); }
+
+AsyncStats GetAsyncStats() noexcept {
+  detail::async::Backend& backend = detail::async::GetBackend();
+  std::lock_guard<std::mutex> lock(backend.mutex);
+  AsyncStats stats = backend.retired;
+  for (const auto& queue : backend.queues) {
+    stats.queued += queue->queued();
+    stats.dropped += queue->dropped();
+  }
+  return stats;
+}
+
+} /* namespace logging */
@@ -0,0 +1,508 @@
+/******************************************************************************
+ * Async.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_ASYNC_HPP_
+#define SRC_LOGGERV2_ASYNC_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#include <fmt/format.h>
+
+#include "P7_Trace.h"
+
+#include "LoggerV2/Coalesce.hpp"
+#include "LoggerV2/CustomSourceLocation.hpp"
+#include "LoggerV2/Field.hpp"
+#include "LoggerV2/Message.hpp"
+
+namespace logging {
+
+/**
+ * @brief What a thread does when its asynchronous queue is full
+ */
+enum class OverflowPolicy : std::uint8_t {
+  kBlock,      /**< @brief Wait for the background thread to make room */
+  kDropNewest, /**< @brief Discard the message being logged */
+  kDropOldest  /**< @brief Discard the oldest queued message */
+};
+
+/**
+ * @brief Options for asynchronous logging
+ */
+struct AsyncOptions {
+  /** @brief Number of messages each thread can queue, rounded up to a power
+   * of two */
+  std::size_t queue_size = 1024;
+  OverflowPolicy policy = OverflowPolicy::kBlock;
+};
+
+/**
+ * @brief Counters of the asynchronous logging backend
+ */
+struct AsyncStats {
+  std::uint64_t queued;  /**< @brief Messages queued since StartAsync */
+  std::uint64_t dropped; /**< @brief Messages dropped since StartAsync */
+};
+
+/**
+ * @brief True for argument types that own everything they format, so that
+ * asynchronous mode and the backtrace ring may copy them and format them
+ * later.  Holds for arithmetic types, enums and pointers, strings are
+ * always copied.  Arguments of other types are formatted by the calling
+ * thread, as they may refer to memory the caller frees once the call
+ * returns, like the results of fmt::join or a std::span.  Specialize it for
+ * types that are safe to copy:
+ * @code
+ * template <>
+ * inline constexpr bool logging::kCopyableArg<Point> = true;
+ * @endcode
+ */
+template <typename T>
+inline constexpr bool kCopyableArg =
+    std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>;
+
+/**
+ * @brief Switches every Log to asynchronous mode.
+ *
+ * Log calls then copy their arguments into a queue owned by the calling
+ * thread, and a background thread formats them and sends them to P7.
+ * Only arguments that own what they format are copied, see kCopyableArg.
+ * Messages with other arguments, or whose arguments do not fit in a queue
+ * slot, are formatted by the calling thread and queued as text.  CRITICAL
+ * messages are still sent synchronously from the calling thread.
+ *
+ * P7 stamps messages with the time and thread that sends them, so queued
+ * messages show the background thread and the time they were sent.
+ * Dropped messages are counted, and reported with a WARNING on the channel
+ * that dropped them.
+ *
+ * @param options Queue size and overflow policy for threads that log after
+ * this call
+ */
+void StartAsync(const AsyncOptions& options = AsyncOptions{});
+
+/**
+ * @brief Sends every queued message and returns to synchronous mode.  Should
+ * be called once the threads that log have stopped, e.g. at shutdown.
+ */
+void StopAsync();
+
+/** @brief Returns the counters of the asynchronous backend */
+AsyncStats GetAsyncStats() noexcept;
+
+namespace detail::async {
+
+/** @brief Bytes available in a queue slot for the format string, encoded
+ * fields and arguments */
+inline constexpr std::size_t kSlotArgsSize = 192;
+
+inline std::atomic<bool> enabled{false};
+
+/** @brief Returns true if Log calls should be queued.  A relaxed load. */
+inline bool Enabled() noexcept {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+/* Strings are copied into the slot and read back as std::string_view, so
+ * that queued messages do not refer to memory owned by the caller.  Char
+ * arrays count as strings.
+ */
+template <typename T>
+inline constexpr bool kIsString =
+    std::is_same_v<std::decay_t<T>, std::string> ||
+    std::is_same_v<std::decay_t<T>, std::string_view> ||
+    std::is_same_v<std::decay_t<T>, const char*> ||
+    std::is_same_v<std::decay_t<T>, char*>;
+
+template <typename T>
+using Decoded = std::conditional_t<kIsString<T>, std::string_view, const T&>;
+
+/** @brief True if an argument can be copied into a slot and formatted by
+ * the background thread */
+template <typename T>
+inline constexpr bool kQueueable =
+    kIsString<T> || kCopyableArg<std::decay_t<T>>;
+
+/**
+ * @brief Writes, reads and destroys the arguments stored in a slot.  All
+ * three walk the arguments in the same order with the same alignment.
+ */
+class ArgCursor {
+ public:
+  explicit ArgCursor(std::byte* data) noexcept : data_(data) {}
+
+  template <typename T>
+  static constexpr std::size_t Size(std::size_t offset, const T& value) {
+    if constexpr (kIsString<T>) {
+      return Align(offset, alignof(std::size_t)) + sizeof(std::size_t) +
+             StringOf(value).size();
+    } else {
+      return Align(offset, alignof(T)) + sizeof(T);
+    }
+  }
+
+  template <typename T>
+  void Write(const T& value) {
+    if constexpr (kIsString<T>) {
+      const std::string_view string = StringOf(value);
+      const std::size_t size = string.size();
+      offset_ = Align(offset_, alignof(std::size_t));
+      std::memcpy(data_ + offset_, &size, sizeof(size));
+      offset_ += sizeof(size);
+      std::memcpy(data_ + offset_, string.data(), size);
+      offset_ += size;
+    } else {
+      offset_ = Align(offset_, alignof(T));
+      ::new (static_cast<void*>(data_ + offset_)) T(value);
+      offset_ += sizeof(T);
+    }
+  }
+
+  template <typename T>
+  Decoded<T> Read() {
+    if constexpr (kIsString<T>) {
+      std::size_t size = 0;
+      offset_ = Align(offset_, alignof(std::size_t));
+      std::memcpy(&size, data_ + offset_, sizeof(size));
+      offset_ += sizeof(size);
+      const std::string_view string(
+          reinterpret_cast<const char*>(data_ + offset_), size);
+      offset_ += size;
+      return string;
+    } else {
+      offset_ = Align(offset_, alignof(T));
+      const T& value = *std::launder(reinterpret_cast<T*>(data_ + offset_));
+      offset_ += sizeof(T);
+      return value;
+    }
+  }
+
+  template <typename T>
+  void Destroy() {
+    if constexpr (kIsString<T> || std::is_trivially_destructible_v<T>) {
+      Read<T>();
+    } else {
+      offset_ = Align(offset_, alignof(T));
+      std::launder(reinterpret_cast<T*>(data_ + offset_))->~T();
+      offset_ += sizeof(T);
+    }
+  }
+
+ private:
+  /* Null C strings are stored as "(null)", as EncodeValue writes them */
+  template <typename T>
+  static constexpr std::string_view StringOf(const T& value) noexcept {
+    if constexpr (std::is_pointer_v<T>) {
+      if (value == nullptr) {
+        return "(null)";
+      }
+    }
+    return std::string_view(value);
+  }
+
+  static constexpr std::size_t Align(const std::size_t offset,
+                                     const std::size_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+  }
+
+  std::byte* data_;
+  std::size_t offset_ = 0;
+};
+
+using FormatFunc = void (*)(std::byte* args, MessageBuffer& message);
+using DestroyFunc = void (*)(std::byte* args);
+
+template <typename... Args>
+void FormatArgs(std::byte* args, MessageBuffer& message) {
+  ArgCursor cursor(args);
+  const std::string_view format = cursor.Read<std::string_view>();
+  const std::string_view fields = cursor.Read<std::string_view>();
+  // Braced initialization reads the arguments in order.
+  const std::tuple<Decoded<Args>...> values{cursor.Read<Args>()...};
+  std::apply(
+      [&](const auto&... all) {
+        fmt::vformat_to(std::back_inserter(message), format,
+                        fmt::make_format_args(all...));
+      },
+      values);
+  RenderFields(fields, message);
+}
+
+template <typename... Args>
+void DestroyArgs(std::byte* args) {
+  ArgCursor cursor(args);
+  cursor.Destroy<std::string_view>();
+  cursor.Destroy<std::string_view>();
+  (cursor.Destroy<Args>(), ...);
+}
+
+/**
+ * @brief A message waiting to be formatted
+ */
+struct Record {
+  IP7_Trace* trace;
+  IP7_Trace::hModule module;
+  CustomSourceLocation loc;
+  FormatFunc format;
+  DestroyFunc destroy;
+  std::int64_t coalesce_window;
+  std::uint16_t id;
+  Level level;
+  bool redact;
+  WrapPolicy wrap;
+};
+
+/**
+ * @brief Stores a message formatted by the calling thread in a slot, inline
+ * if it fits, else in a string the slot owns.  Sets the format and destroy
+ * functions of the record.
+ */
+void StoreText(Record& record, std::byte* args, const std::string_view text);
+
+struct alignas(64) Slot {
+  /* Equal to the queue position the slot can be written at when empty,
+   * that position + 1 when it holds a record, or kClaimed while a record is
+   * being consumed or dropped. */
+  std::atomic<std::uint64_t> sequence;
+  Record record;
+  alignas(std::max_align_t) std::byte args[kSlotArgsSize];
+};
+
+/**
+ * @brief Bounded single-producer queue owned by one logging thread.
+ *
+ * Only the owning thread pushes.  Records are claimed, by the background
+ * thread to consume them or by the owning thread to drop the oldest one,
+ * with a compare-and-swap on the slot sequence.
+ */
+class ThreadQueue {
+ public:
+  ThreadQueue(const std::size_t size, const OverflowPolicy policy);
+  /* Destroys the records left in the queue, see DropPending */
+  ~ThreadQueue();
+
+  ThreadQueue(const ThreadQueue& rhs) = delete;
+  ThreadQueue& operator=(const ThreadQueue& rhs) = delete;
+
+  /**
+   * @brief Copies a message into the queue
+   *
+   * @param fields Structured fields encoded by EncodeField, rendered after
+   * the message is formatted
+   * @return Returns false if the message must be sent synchronously
+   * instead, because it does not fit in a slot or the backend stopped.
+   */
+  template <typename... Args>
+  bool Push(IP7_Trace* trace, const Level level, const std::uint16_t id,
+            const IP7_Trace::hModule module, const CustomSourceLocation& loc,
+            const std::int64_t coalesce_window, const WrapPolicy wrap,
+            const bool redact, const std::string_view format,
+            const std::string_view fields, const Args&... all) {
+    static_assert((kQueueable<Args> && ...),
+                  "Arguments must be formatted by the caller");
+    std::size_t size = ArgCursor::Size(0, format);
+    size = ArgCursor::Size(size, fields);
+    ((size = ArgCursor::Size(size, all)), ...);
+    if (size > kSlotArgsSize) {
+      return false;
+    }
+
+    bool dropped = false;
+    Slot* const slot = Claim(trace, dropped);
+    if (slot == nullptr) {
+      return dropped;
+    }
+    slot->record = Record{trace,
+                          module,
+                          loc,
+                          &FormatArgs<Args...>,
+                          &DestroyArgs<Args...>,
+                          coalesce_window,
+                          id,
+                          level,
+                          redact,
+                          wrap};
+    ArgCursor cursor(slot->args);
+    cursor.Write(format);
+    cursor.Write(fields);
+    (cursor.Write(all), ...);
+    Publish(*slot);
+    return true;
+  }
+
+  /**
+   * @brief Copies a message formatted by the calling thread into the queue,
+   * see StoreText
+   *
+   * @return Returns false if the backend stopped
+   */
+  bool PushText(IP7_Trace* trace, const Level level, const std::uint16_t id,
+                const IP7_Trace::hModule module,
+                const CustomSourceLocation& loc,
+                const std::int64_t coalesce_window, const WrapPolicy wrap,
+                const bool redact, const std::string_view text);
+
+  /**
+   * @brief Formats and sends the oldest record.  Called by the background
+   * thread only.
+   *
+   * @return Returns false if the queue was empty
+   */
+  bool Consume();
+
+  /**
+   * @brief Destroys the records that were not consumed, counting them as
+   * dropped.  Called once the background thread stopped.
+   */
+  void DropPending();
+
+  /** @brief Returns true if every pushed record has been consumed */
+  bool Empty() const noexcept;
+
+  std::uint64_t queued() const noexcept {
+    return queued_.load(std::memory_order_relaxed);
+  }
+  std::uint64_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Channel of the most recently dropped record */
+  IP7_Trace* drop_trace() const noexcept {
+    return drop_trace_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Returns the number of records dropped since the last call.
+   * Called by the background thread only.
+   */
+  std::uint64_t TakeDropped() noexcept;
+
+  /**
+   * @brief Coalescing state of the records of this queue, so that repeats
+   * are counted per producing thread.  Used by the background thread only.
+   */
+  Streak& streak() noexcept { return streak_; }
+
+  /** @brief Set when the owning thread exits */
+  std::atomic<bool> closed{false};
+
+ private:
+  static inline constexpr std::uint64_t kClaimed = UINT64_MAX;
+
+  /* Returns the slot at the head once it is free, waiting or dropping as
+   * the overflow policy says.  Returns nullptr if the message was dropped,
+   * with dropped set, or if the backend stopped. */
+  Slot* Claim(IP7_Trace* trace, bool& dropped) {
+    const std::uint64_t position = head_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[position & mask_];
+    while (slot.sequence.load(std::memory_order_acquire) != position) {
+      if (!Enabled()) {
+        return nullptr;
+      }
+      switch (policy_) {
+        case OverflowPolicy::kDropNewest:
+          Dropped(trace);
+          dropped = true;
+          return nullptr;
+        case OverflowPolicy::kDropOldest:
+          if (!DropOldest()) {
+            Wait();
+          }
+          break;
+        case OverflowPolicy::kBlock:
+          Wait();
+          break;
+      }
+    }
+    return &slot;
+  }
+
+  /* Hands the slot returned by Claim to the background thread */
+  void Publish(Slot& slot) noexcept {
+    const std::uint64_t position = head_.load(std::memory_order_relaxed);
+    slot.sequence.store(position + 1, std::memory_order_release);
+    head_.store(position + 1, std::memory_order_release);
+    queued_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  bool DropOldest();
+  void Dropped(IP7_Trace* trace) noexcept;
+  static void Wait() noexcept;
+
+  std::unique_ptr<Slot[]> slots_;
+  std::uint64_t mask_;
+  OverflowPolicy policy_;
+  std::atomic<std::uint64_t> queued_{0};
+  std::atomic<std::uint64_t> dropped_{0};
+  std::atomic<IP7_Trace*> drop_trace_{nullptr};
+  std::uint64_t reported_ = 0;
+  Streak streak_;
+  alignas(64) std::atomic<std::uint64_t> head_{0};
+  alignas(64) std::atomic<std::uint64_t> tail_{0};
+};
+
+/**
+ * @brief Returns the calling thread's queue, creating and registering it on
+ * first use.  Also keeps a reference to the channel, so that it outlives the
+ * records that point to it.
+ */
+ThreadQueue& LocalQueue(IP7_Trace* trace);
+
+/**
+ * @brief Queues a message for the background thread
+ *
+ * @return Returns false if the message must be sent synchronously
+ */
+template <typename... Args>
+bool Enqueue(IP7_Trace* trace, const Level level, const std::uint16_t id,
+             const IP7_Trace::hModule module, const CustomSourceLocation& loc,
+             const std::int64_t coalesce_window, const WrapPolicy wrap,
+             const bool redact, const std::string_view format,
+             const std::string_view fields, const Args&... all) {
+  return LocalQueue(trace).Push(trace, level, id, module, loc,
+                                coalesce_window, wrap, redact, format, fields,
+                                all...);
+}
+
+/**
+ * @brief Queues a message formatted by the calling thread
+ *
+ * @return Returns false if the message must be sent synchronously
+ */
+bool EnqueueText(IP7_Trace* trace, const Level level, const std::uint16_t id,
+                 const IP7_Trace::hModule module,
+                 const CustomSourceLocation& loc,
+                 const std::int64_t coalesce_window, const WrapPolicy wrap,
+                 const bool redact, const std::string_view text);
+
+} /* namespace detail::async */
+
+} /* namespace logging */
+
+#endif /* SRC_LOGGERV2_ASYNC_HPP_ */
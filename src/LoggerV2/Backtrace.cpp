@@ -0,0 +1,131 @@
+/******************************************************************************
+ * Backtrace.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/Backtrace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "LoggerV2/Message.hpp"
+#include "LoggerV2/Redaction.hpp"
+#include "LoggerV2/SourceName.hpp"
+
+namespace logging {
+
+namespace detail::backtrace {
+
+namespace {
+
+std::atomic<std::size_t> ring_size{BacktraceOptions{}.size};
+
+/** @brief Suppressed messages of one thread, oldest first from next */
+struct Ring {
+  explicit Ring(const std::size_t size) : entries(size) {}
+  ~Ring() {
+    for (Entry& entry : entries) {
+      Clear(entry);
+    }
+  }
+
+  static void Clear(Entry& entry) noexcept {
+    if (entry.record.destroy != nullptr) {
+      entry.record.destroy(entry.args);
+      entry.record.destroy = nullptr;
+    }
+  }
+
+  std::vector<Entry> entries;
+  std::size_t next = 0;
+};
+
+thread_local std::unique_ptr<Ring> ring;
+
+} /* namespace */
+
+Entry& Reserve() {
+  if (!ring) {
+    ring = std::make_unique<Ring>(
+        std::max<std::size_t>(ring_size.load(std::memory_order_relaxed), 1));
+  }
+  Entry& entry = ring->entries[ring->next];
+  ring->next = (ring->next + 1) % ring->entries.size();
+  Ring::Clear(entry);
+  return entry;
+}
+
+void Flush(IP7_Trace* trace, const Level level, const std::uint16_t id,
+           const IP7_Trace::hModule module, const CustomSourceLocation& loc,
+           const WrapPolicy wrap) {
+  if (!ring) {
+    return;
+  }
+  MessageBuffer message;
+  const std::size_t size = ring->entries.size();
+  for (std::size_t i = 0; i < size; ++i) {
+    Entry& entry = ring->entries[(ring->next + i) % size];
+    const async::Record& record = entry.record;
+    if (record.destroy == nullptr || record.trace != trace) {
+      continue;
+    }
+    if (message.size() == 0) {
+      fmt::format_to(std::back_inserter(message),
+                     "Backtrace of the suppressed messages before this one:");
+    }
+    fmt::format_to(std::back_inserter(message), "\n{} {}:{} {}: ",
+                   LevelName(record.level),
+                   TrimFileName(record.loc.file_name()), record.loc.line(),
+                   record.loc.function_name());
+    const std::size_t text = message.size();
+    try {
+      record.format(entry.args, message);
+    } catch (const std::exception& e) {
+      fmt::format_to(std::back_inserter(message),
+                     "Failed to format log message: {}", e.what());
+    }
+    if (record.redact) {
+      Redact(message.data() + text, message.size() - text);
+    }
+    Ring::Clear(entry);
+  }
+  if (message.size() != 0) {
+    TraceMessage(trace, level, id, module, loc, message, wrap);
+  }
+}
+
+} /* namespace detail::backtrace */
+
+void EnableBacktrace(const BacktraceOptions& options) {
+  detail::backtrace::ring_size.store(options.size, std::memory_order_relaxed);
+  detail::backtrace::trigger.store(static_cast<std::uint8_t>(options.trigger),
+                                   std::memory_order_relaxed);
+}
+
+void DisableBacktrace() noexcept {
+  detail::backtrace::trigger.store(detail::backtrace::kDisabled,
+                                   std::memory_order_relaxed);
+}
+
+} /* namespace logging */
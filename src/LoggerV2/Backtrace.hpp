@@ -0,0 +1,150 @@
+/******************************************************************************
+ * Backtrace.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_BACKTRACE_HPP_
+#define SRC_LOGGERV2_BACKTRACE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "P7_Trace.h"
+
+#include "LoggerV2/Async.hpp"
+#include "LoggerV2/CustomSourceLocation.hpp"
+#include "LoggerV2/Field.hpp"
+#include "LoggerV2/Lazy.hpp"
+#include "LoggerV2/Message.hpp"
+
+namespace logging {
+
+/**
+ * @brief Options of the backtrace ring, see EnableBacktrace
+ */
+struct BacktraceOptions {
+  /** @brief Suppressed messages each thread keeps */
+  std::size_t size = 32;
+  /** @brief Lowest level of the messages that send the backtrace */
+  Level trigger = Level::ERROR;
+};
+
+/**
+ * @brief Keeps the last messages each thread logs below the verbosity, and
+ * sends them when the thread logs at or above the trigger level.
+ *
+ * Suppressed messages are copied in binary form, like queued messages in
+ * asynchronous mode, and are only formatted if a trigger sends them.  The
+ * backtrace of a channel is sent as one message just before the message
+ * that triggered it, at the same level and module, with one line per
+ * remembered message.  Messages with lazy arguments, with format arguments
+ * that may refer to memory of the caller (see kCopyableArg), or whose
+ * arguments do not fit in a queue slot, are not remembered.
+ *
+ * @param options Ring size, for threads that log after this call, and
+ * trigger level
+ */
+void EnableBacktrace(const BacktraceOptions& options = BacktraceOptions{});
+
+/** @brief Stops remembering suppressed messages */
+void DisableBacktrace() noexcept;
+
+namespace detail::backtrace {
+
+inline constexpr std::uint8_t kDisabled = UINT8_MAX;
+
+/** @brief Raw trigger level, or kDisabled */
+inline std::atomic<std::uint8_t> trigger{kDisabled};
+
+/** @brief Returns true if suppressed messages are remembered */
+inline bool Enabled() noexcept {
+  return trigger.load(std::memory_order_relaxed) != kDisabled;
+}
+
+/** @brief Returns true if a message of a level sends the backtrace */
+inline bool Triggers(const Level level) noexcept {
+  return static_cast<std::uint8_t>(level) >=
+         trigger.load(std::memory_order_relaxed);
+}
+
+/* Format arguments are copied, so only those that own what they format
+ * are kept, see kCopyableArg, which also leaves out lazy ones.  Fields are
+ * encoded by the caller, except lazy ones, which are left unevaluated. */
+template <typename T>
+inline constexpr bool kKeeps = async::kQueueable<T>;
+template <typename T>
+inline constexpr bool kKeeps<Field<T>> = !kIsLazy<T>;
+
+/** @brief True if a message with these arguments can be remembered */
+template <typename... Args>
+inline constexpr bool kRememberable = (kKeeps<Args> && ...);
+
+struct Entry {
+  async::Record record{};
+  alignas(std::max_align_t) std::byte args[async::kSlotArgsSize];
+};
+
+/**
+ * @brief Returns the entry of the calling thread's ring to overwrite, with
+ * its previous record destroyed
+ */
+Entry& Reserve();
+
+/** @brief Copies a suppressed message into the calling thread's ring */
+template <typename... Args>
+void Remember(IP7_Trace* trace, const Level level, const std::uint16_t id,
+              const IP7_Trace::hModule module, const CustomSourceLocation& loc,
+              const bool redact, const std::string_view format,
+              const std::string_view fields, const Args&... all) {
+  std::size_t size = async::ArgCursor::Size(0, format);
+  size = async::ArgCursor::Size(size, fields);
+  ((size = async::ArgCursor::Size(size, all)), ...);
+  if (size > async::kSlotArgsSize) {
+    return;
+  }
+  Entry& entry = Reserve();
+  entry.record = async::Record{trace,
+                               module,
+                               loc,
+                               &async::FormatArgs<Args...>,
+                               &async::DestroyArgs<Args...>,
+                               0,
+                               id,
+                               level,
+                               redact,
+                               WrapPolicy{}};
+  async::ArgCursor cursor(entry.args);
+  cursor.Write(format);
+  cursor.Write(fields);
+  (cursor.Write(all), ...);
+}
+
+/**
+ * @brief Sends the messages the calling thread remembered for a channel, as
+ * one message cut by the channel's wrap policy, and forgets them
+ */
+void Flush(IP7_Trace* trace, const Level level, const std::uint16_t id,
+           const IP7_Trace::hModule module, const CustomSourceLocation& loc,
+           const WrapPolicy wrap);
+
+} /* namespace detail::backtrace */
+
+} /* namespace logging */
+
+#endif /* SRC_LOGGERV2_BACKTRACE_HPP_ */
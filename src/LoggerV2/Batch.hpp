@@ -0,0 +1,135 @@
+/******************************************************************************
+ * Batch.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_BATCH_HPP_
+#define SRC_LOGGERV2_BATCH_HPP_
+
+#include <cstddef>
+#include <exception>
+#include <string_view>
+
+#include "LoggerV2/CustomSourceLocation.hpp"
+#include "LoggerV2/Field.hpp"
+#include "LoggerV2/FormatString.hpp"
+#include "LoggerV2/Log.hpp"
+#include "LoggerV2/Message.hpp"
+#include "LoggerV2/ModuleHandle.hpp"
+
+namespace logging {
+
+/**
+ * @brief Collects related lines and sends them as one message:
+ * @code
+ * logging::Batch batch(log, Level::DEBUG, mh);
+ * for (const Item& item : items) {
+ *   batch.Add("{:>8} {}", item.id, item.result);
+ * }
+ * batch.Submit();  // or let the batch go out of scope
+ * @endcode
+ * The verbosity is checked once, when the batch is created, and disabled
+ * batches do not format their records.  Records are formatted into a buffer
+ * the batch reuses after each Submit, and sent as one message, so the whole
+ * batch costs one thread registration check and one coalescing lookup.  In
+ * asynchronous mode it takes one queue slot, which owns a copy of the
+ * records when they do not fit in the slot.  P7 still receives each line
+ * as a record of its own, as it does for any multiline message.
+ *
+ * Every record is sent with the location of the batch, where it was
+ * created, rather than the location of its Add.  Likewise, the fields of
+ * the ScopedContext active at Submit are rendered once, after the last
+ * record, while the fields passed to Add follow their own record.
+ */
+class Batch {
+ public:
+  Batch(const Log& log, const Level level,
+        const ModuleHandle& handle = ModuleHandle{},
+        const CustomSourceLocation loc = CustomSourceLocation::current())
+      : log_(log),
+        handle_(handle),
+        loc_(loc),
+        level_(level),
+        enabled_(IsCompiledIn(level) && log.IsEnabled(level, handle)) {}
+  ~Batch() {
+    /* Errors cannot leave the destructor, so the records are dropped. */
+    try {
+      Submit();
+    } catch (const std::exception& /*e*/) {
+    }
+  }
+
+  Batch(const Batch& rhs) = delete;
+  Batch& operator=(const Batch& rhs) = delete;
+
+  /** @brief Returns true if the records of the batch will be sent */
+  inline bool enabled() const noexcept { return enabled_; }
+  /** @brief Returns the number of records waiting for Submit */
+  inline std::size_t size() const noexcept { return count_; }
+
+  /**
+   * @brief Appends a record.  Takes the same format, arguments and fields as
+   * the Log functions.
+   */
+  template <typename... Args>
+  Batch& Add(const FormatString<Args...> format, const Args&... all) {
+    static_assert(detail::FieldsLast<Args...>(),
+                  "Fields must follow the format arguments");
+    if (!enabled_) {
+      return *this;
+    }
+    if (count_++ != 0) {
+      records_.push_back('\n');
+    }
+    if constexpr (detail::kFieldCount<Args...> == 0) {
+      format.Format(records_, all...);
+    } else {
+      /* Fields are rendered around each record, not around the batch. */
+      MessageBuffer record;
+      format.Format(record, all...);
+      detail::FieldBuffer fields;
+      (detail::EncodeField(fields, all), ...);
+      detail::RenderFields(std::string_view(fields.data(), fields.size()),
+                           record);
+      records_.append(record);
+    }
+    return *this;
+  }
+
+  /** @brief Sends the records added since the last Submit, if any */
+  void Submit() {
+    if (count_ == 0) {
+      return;
+    }
+    log_.SendText(level_, handle_, loc_, records_);
+    records_.clear();
+    count_ = 0;
+  }
+
+ private:
+  Log log_;
+  ModuleHandle handle_;
+  CustomSourceLocation loc_;
+  Level level_;
+  bool enabled_;
+  std::size_t count_ = 0;
+  MessageBuffer records_;
+};
+
+} /* namespace logging */
+
+#endif /* SRC_LOGGERV2_BATCH_HPP_ */
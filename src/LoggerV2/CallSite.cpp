@@ -0,0 +1,146 @@
+/******************************************************************************
+ * CallSite.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/CallSite.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <fmt/format.h>
+
+namespace logging {
+
+namespace {
+
+struct SiteRegistry {
+  std::vector<CallSite*> sites;
+  /* The patterns given to SetSiteState, the latest last */
+  std::vector<std::pair<std::string, SiteState>> patterns;
+};
+
+/* Sites may run during static destruction, so these are never destroyed. */
+std::mutex& RegistryMutex() {
+  static auto* mutex = new std::mutex;
+  return *mutex;
+}
+
+SiteRegistry& Registry() {
+  static auto* registry = new SiteRegistry;
+  return *registry;
+}
+
+bool SiteMatches(const CallSite& site, const std::string_view pattern,
+                 fmt::memory_buffer& location) {
+  location.clear();
+  fmt::format_to(std::back_inserter(location), "{}:{}", site.file,
+                 site.line);
+  const std::string_view text(location.data(), location.size());
+  return detail::GlobMatch(pattern, text) ||
+         detail::GlobMatch(pattern, site.function);
+}
+
+} /* namespace */
+
+std::vector<const CallSite*> GetCallSites() {
+  std::lock_guard<std::mutex> lock(RegistryMutex());
+  const auto& sites = Registry().sites;
+  return {sites.begin(), sites.end()};
+}
+
+std::size_t SetSiteState(const std::string_view pattern,
+                         const SiteState state) {
+  std::lock_guard<std::mutex> lock(RegistryMutex());
+  SiteRegistry& registry = Registry();
+  /* Added before the old entry is erased, so a throw changes nothing */
+  registry.patterns.emplace_back(pattern, state);
+  registry.patterns.erase(
+      std::remove_if(registry.patterns.begin(), registry.patterns.end() - 1,
+                     [pattern](const auto& entry) {
+                       return entry.first == pattern;
+                     }),
+      registry.patterns.end() - 1);
+
+  std::size_t matched = 0;
+  fmt::memory_buffer location;
+  for (CallSite* site : registry.sites) {
+    if (SiteMatches(*site, pattern, location)) {
+      site->state.store(state, std::memory_order_relaxed);
+      ++matched;
+    }
+  }
+  return matched;
+}
+
+namespace detail {
+
+void RegisterSite(CallSite& site) {
+  std::lock_guard<std::mutex> lock(RegistryMutex());
+  /* Another thread may have run the site first */
+  if (site.state.load(std::memory_order_relaxed) != kUnregisteredSite) {
+    return;
+  }
+  SiteRegistry& registry = Registry();
+  SiteState state = SiteState::kDefault;
+  fmt::memory_buffer location;
+  for (auto it = registry.patterns.rbegin(); it != registry.patterns.rend();
+       ++it) {
+    if (SiteMatches(site, it->first, location)) {
+      state = it->second;
+      break;
+    }
+  }
+  registry.sites.push_back(&site);
+  site.state.store(state, std::memory_order_relaxed);
+}
+
+bool GlobMatch(const std::string_view pattern,
+               const std::string_view text) noexcept {
+  /* Backtracks to the last star only, which is enough as a later star can
+   * match anything an earlier one could. */
+  std::size_t p = 0;
+  std::size_t t = 0;
+  std::size_t star = std::string_view::npos;
+  std::size_t resume = 0;
+  while (t < text.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+      ++p;
+      ++t;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      resume = t;
+    } else if (star != std::string_view::npos) {
+      p = star + 1;
+      t = ++resume;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*') {
+    ++p;
+  }
+  return p == pattern.size();
+}
+
+} /* namespace detail */
+
+} /* namespace logging */
@@ -0,0 +1,174 @@
+/******************************************************************************
+ * CallSite.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_CALLSITE_HPP_
+#define SRC_LOGGERV2_CALLSITE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include <boost/preprocessor/cat.hpp>
+
+#include "LoggerV2/CustomSourceLocation.hpp"
+#include "LoggerV2/FormatString.hpp"
+#include "LoggerV2/Message.hpp"
+#include "LoggerV2/RateLimit.hpp"
+#include "LoggerV2/SourceName.hpp"
+
+namespace logging {
+
+/**
+ * @brief Runtime override of a call site, see SetSiteState.  Each run of a
+ * site loads its state first, so a disabled site costs one load and a
+ * branch, and a site in the default state costs that load on top of the
+ * usual verbosity check.
+ */
+enum class SiteState : std::uint8_t {
+  /** @brief The site follows the channel and module verbosity */
+  kDefault,
+  /** @brief The site skips the verbosity cache */
+  kEnabled,
+  /** @brief The site sends nothing */
+  kDisabled,
+};
+
+namespace detail {
+
+/** @brief State of a site that has not run yet, see RegisterSite */
+inline constexpr auto kUnregisteredSite = static_cast<SiteState>(0xff);
+
+} /* namespace detail */
+
+/**
+ * @brief Static description of one LOG_SITE call site.
+ *
+ * Each LOG_SITE statement holds one CallSite, and passes a reference to it
+ * instead of a source location.  A site registers itself the first time it
+ * runs, after which it is listed by GetCallSites, e.g. so that a sink can
+ * send the metadata of each site once.
+ *
+ * Sites are not kept in a linker section, as GCC ignores section attributes
+ * in templates and refuses to put the statics of inline and non-inline
+ * functions in the same section.  The file and function names are trimmed
+ * at compile time, see SourceName.hpp.
+ */
+struct CallSite {
+  const char* file;
+  const char* function;
+  const char* format;
+  std::uint32_t line;
+  std::uint32_t column;
+  Level level;
+  std::atomic<SiteState> state{detail::kUnregisteredSite};
+};
+
+/**
+ * @brief Returns the call sites that have run at least once, in the order
+ * they first ran.
+ */
+std::vector<const CallSite*> GetCallSites();
+
+/**
+ * @brief Overrides the verbosity of the call sites matching a pattern:
+ * @code
+ * logging::SetSiteState("*Renderer.cpp:12?", logging::SiteState::kEnabled);
+ * logging::SetSiteState("Flush", logging::SiteState::kDisabled);
+ * @endcode
+ * The pattern is a glob, where * matches any run of characters and ? any one
+ * character, and is matched against both "file:line" and the function name.
+ * The state also applies to matching sites that have not run yet; the last
+ * matching pattern wins.
+ *
+ * Only statements written with LOG_SITE or LOG_SITE_MODULE have a site.
+ * Plain calls such as log.Debug(...) are not matched, so a statement has to
+ * be converted to LOG_SITE before it can be toggled.
+ *
+ * An enabled site skips the verbosity cache.  P7 would still drop its
+ * messages below the channel or module verbosity, so those are sent at that
+ * verbosity, with the level of the site written before the text.
+ *
+ * @return Returns the number of sites already run that matched
+ */
+std::size_t SetSiteState(const std::string_view pattern,
+                         const SiteState state);
+
+namespace detail {
+
+/** @brief Returns the text of a string literal or _log format */
+template <std::size_t N>
+constexpr const char* SiteFormat(const char (&format)[N]) noexcept {
+  return format;
+}
+template <FixedString kText>
+constexpr const char* SiteFormat(StaticFormat<kText> /*unused*/) noexcept {
+  return kText.value;
+}
+
+/**
+ * @brief Adds a site to GetCallSites and sets its state from the patterns
+ * given to SetSiteState so far.  Called by the first run of the site; if it
+ * throws, the site stays unregistered and the next run tries again.
+ */
+[[gnu::cold]] void RegisterSite(CallSite& site);
+
+/** @brief Matches text against a glob of * and ? wildcards */
+bool GlobMatch(const std::string_view pattern,
+               const std::string_view text) noexcept;
+
+} /* namespace detail */
+
+} /* namespace logging */
+
+/**
+ * @brief Log call with a static call site, see CallSite:
+ * @code
+ * LOG_SITE(log, Debug, "Frame {} took {} ms", frame, ms);
+ * LOG_SITE_MODULE(log, Warning, mh, "Queue {} full", id);
+ * @endcode
+ * The method is one of Trace, Debug, Info, Warn, Warning, Error, Critical,
+ * Crit or Count, and the format a string literal or _log format.
+ */
+#define LOG_SITE(log, method, format, ...)                                   \
+  LOG_SITE_MODULE(log, method, ::logging::ModuleHandle{},                    \
+                  format __VA_OPT__(, ) __VA_ARGS__)
+
+// clang-format off
+#define LOG_SITE_MODULE(log, method, handle, format, ...)                    \
+  do {                                                                       \
+    static constexpr auto log_internal_function =                            \
+        ::logging::detail::StoreName<                                        \
+            ::logging::detail::SimplifyFunctionName(__PRETTY_FUNCTION__)     \
+                .size()>(                                                    \
+            ::logging::detail::SimplifyFunctionName(__PRETTY_FUNCTION__));   \
+    static constinit ::logging::CallSite log_internal_site{                  \
+        ::logging::detail::TrimFileName(__FILE__),                           \
+        log_internal_function.data(),                                        \
+        ::logging::detail::SiteFormat(format),                               \
+        __LINE__,                                                            \
+        ::logging::CustomSourceLocation::current().column(),                 \
+        BOOST_PP_CAT(LOG_INTERNAL_LEVEL_, method)()};                        \
+    (log).SiteTrace(log_internal_site, handle,                               \
+                    format __VA_OPT__(, ) __VA_ARGS__);                      \
+  } while (false)
+// clang-format on
+
+#endif /* SRC_LOGGERV2_CALLSITE_HPP_ */
@@ -0,0 +1,170 @@
+/******************************************************************************
+ * Capture.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_CAPTURE_HPP_
+#define SRC_LOGGERV2_CAPTURE_HPP_
+
+#include <cstddef>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include "LoggerV2/FormatString.hpp"
+
+namespace logging::detail {
+
+/**
+ * @brief The source text of the expressions passed to CAPTURE
+ */
+template <FixedString kNames>
+struct CaptureNames {};
+
+struct CaptureLayout {
+  std::size_t size;
+  std::size_t count;
+};
+
+/**
+ * @brief Writes the format of a CAPTURE, "a = {} | b = {}", for the source
+ * text of its expressions.
+ *
+ * The text is split at commas outside of brackets and literals, and braces
+ * in it are escaped.  Nothing is written if out is nullptr, so that the size
+ * can be computed first.
+ */
+constexpr CaptureLayout WriteCaptureFormat(const std::string_view names,
+                                           char* const out) noexcept {
+  constexpr std::string_view kField = " = {}";
+  constexpr std::string_view kSeparator = " | ";
+  CaptureLayout layout{0, 1};
+  const auto put_text = [&](const std::string_view text) {
+    for (const char c : text) {
+      if (out != nullptr) {
+        out[layout.size] = c;
+      }
+      ++layout.size;
+    }
+  };
+  const auto put = [&](const char c) {
+    put_text(std::string_view(&c, 1));
+    if (c == '{' || c == '}') {
+      put_text(std::string_view(&c, 1));
+    }
+  };
+
+  int depth = 0;
+  char quote = '\0';
+  bool escaped = false;
+  /* Spaces are dropped around the expressions, and kept inside them. */
+  bool leading = true;
+  std::size_t spaces = 0;
+  for (const char c : names) {
+    if (quote != '\0') {
+      put(c);
+      if (escaped) {
+        escaped = false;
+      } else if (c == '\\') {
+        escaped = true;
+      } else if (c == quote) {
+        quote = '\0';
+      }
+      continue;
+    }
+    if (c == ' ') {
+      ++spaces;
+      continue;
+    }
+    if (c == ',' && depth == 0) {
+      put_text(kField);
+      put_text(kSeparator);
+      ++layout.count;
+      leading = true;
+      spaces = 0;
+      continue;
+    }
+    for (; spaces != 0 && !leading; --spaces) {
+      put(' ');
+    }
+    leading = false;
+    spaces = 0;
+    if (c == '"' || c == '\'') {
+      quote = c;
+    } else if (c == '(' || c == '[' || c == '{') {
+      ++depth;
+    } else if (c == ')' || c == ']' || c == '}') {
+      --depth;
+    }
+    put(c);
+  }
+  put_text(kField);
+  return layout;
+}
+
+/** @brief The format of a CAPTURE, built at compile time */
+template <FixedString kNames>
+struct CaptureFormat {
+  static constexpr CaptureLayout kLayout =
+      WriteCaptureFormat(kNames.view(), nullptr);
+
+  static constexpr FixedString<kLayout.size + 1> Build() noexcept {
+    char text[kLayout.size + 1]{};
+    WriteCaptureFormat(kNames.view(), text);
+    return FixedString<kLayout.size + 1>(text);
+  }
+
+  static constexpr FixedString<kLayout.size + 1> kText = Build();
+  /** @brief Number of expressions */
+  static constexpr std::size_t kCount = kLayout.count;
+};
+
+/**
+ * @brief Holds the values of the CAPTURE expressions.  Lvalues are held by
+ * reference and temporaries by value, so that none of them dangle.
+ */
+template <typename... Args>
+constexpr std::tuple<Args...> CaptureTuple(Args&&... all) {
+  return std::tuple<Args...>(std::forward<Args>(all)...);
+}
+
+} /* namespace logging::detail */
+
+/**
+ * @brief Logs expressions with their source text, at TRACE on the channel:
+ * @code log.CAPTURE(width, height, area()); @endcode
+ * sends "width = 1 | height = 2 | area() = 2".  Any number of expressions
+ * can be captured.  They are evaluated once, only if the message passes the
+ * verbosity check.
+ */
+#define CAPTURE(...)                                                      \
+  Capture(::logging::Level::TRACE, ::logging::ModuleHandle{},             \
+          ::logging::detail::CaptureNames<#__VA_ARGS__>{},                \
+          [&]() { return ::logging::detail::CaptureTuple(__VA_ARGS__); })
+
+/** @brief CAPTURE at another level: log.CAPTURE_LEVEL(Level::INFO, x) */
+#define CAPTURE_LEVEL(level, ...)                                         \
+  Capture(level, ::logging::ModuleHandle{},                               \
+          ::logging::detail::CaptureNames<#__VA_ARGS__>{},                \
+          [&]() { return ::logging::detail::CaptureTuple(__VA_ARGS__); })
+
+/** @brief CAPTURE to a module: log.CAPTURE_MODULE(Level::INFO, mh, x) */
+#define CAPTURE_MODULE(level, handle, ...)                                \
+  Capture(level, handle, ::logging::detail::CaptureNames<#__VA_ARGS__>{}, \
+          [&]() { return ::logging::detail::CaptureTuple(__VA_ARGS__); })
+
+#endif /* SRC_LOGGERV2_CAPTURE_HPP_ */
@@ -0,0 +1,128 @@
+/******************************************************************************
+ * Channel.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/Channel.hpp"
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "P7_Trace.h"
+
+#include "LoggerV2/Client.hpp"
+
+namespace logging {
+
+namespace {
+
+/* Number of channels each thread caches, a power of two */
+constexpr std::size_t kCacheSize = 16;
+
+struct CacheEntry {
+  std::string name;
+  Channel channel;
+  bool valid = false;
+};
+
+thread_local std::array<CacheEntry, kCacheSize> cache;
+
+/* Used by ExitHandler, so these are never destroyed. */
+std::mutex& RegistryMutex() {
+  static auto* mutex = new std::mutex;
+  return *mutex;
+}
+
+std::map<std::string, Channel, std::less<>>& Registry() {
+  static auto* registry = new std::map<std::string, Channel, std::less<>>;
+  return *registry;
+}
+
+/* Opens the channel, keeping one reference to it for the rest of the
+ * process.  Returns a disabled channel if logging is disabled. */
+Channel OpenChannel(const std::string& name) {
+  using namespace std::literals::string_literals;
+
+  Channel channel;
+  if (!Client::LoggingEnabled()) {
+    // P7 is switched off, leave the channel unset so every level is
+    // filtered by the verbosity cache.
+    return channel;
+  }
+  if ((channel.trace = P7_Get_Shared_Trace(name.c_str())) != nullptr) {
+    channel.verbosity = detail::VerbosityCache::ForChannel(channel.trace);
+    return channel;
+  }
+
+  Client client("main");
+  auto verbosity = std::make_unique<detail::VerbosityCache>(0);
+  stTrace_Conf trace_conf{};
+  trace_conf.pContext = verbosity.get();
+  trace_conf.qwTimestamp_Frequency = 0;
+  trace_conf.pTimestamp_Callback = nullptr;
+  trace_conf.pVerbosity_Callback = &detail::VerbosityCache::OnVerbosityChanged;
+  trace_conf.pConnect_Callback = nullptr;
+
+  if ((channel.trace = P7_Create_Trace(client.client(), name.c_str(),
+                                       &trace_conf)) == nullptr) {
+    throw std::runtime_error("P7_Create_Trace failed");
+  }
+  channel.verbosity =
+      detail::VerbosityCache::Attach(channel.trace, std::move(verbosity));
+  if (!channel.trace->Share(name.c_str())) {
+    throw std::runtime_error("trace->Share("s + name + ") failed."s);
+  }
+  return channel;
+}
+
+} /* namespace */
+
+Channel GetChannel(const std::string_view name) {
+  CacheEntry& entry =
+      cache[std::hash<std::string_view>{}(name) & (kCacheSize - 1)];
+  if (entry.valid && entry.name == name) {
+    return entry.channel;
+  }
+
+  Channel channel;
+  {
+    std::lock_guard<std::mutex> lock(RegistryMutex());
+    auto& registry = Registry();
+    auto it = registry.find(name);
+    if (it == registry.end()) {
+      std::string key(name);
+      /* Disabled channels are kept too, so that they are not looked up
+       * under the lock again. */
+      channel = OpenChannel(key);
+      it = registry.emplace(std::move(key), channel).first;
+    }
+    channel = it->second;
+  }
+  entry.name.assign(name);
+  entry.channel = channel;
+  entry.valid = true;
+  return channel;
+}
+
+} /* namespace logging */
@@ -0,0 +1,58 @@
+/******************************************************************************
+ * Channel.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_CHANNEL_HPP_
+#define SRC_LOGGERV2_CHANNEL_HPP_
+
+#include <string_view>
+#include <type_traits>
+
+#include "P7_Trace.h"
+
+#include "LoggerV2/VerbosityCache.hpp"
+
+namespace logging {
+
+/**
+ * @brief A trace channel resolved by name
+ *
+ * Channels are created on first use and live for the rest of the process,
+ * so a Channel can be copied and kept without reference counting.  A
+ * default constructed Channel drops every message.
+ */
+struct Channel {
+  IP7_Trace* trace = nullptr;
+  detail::VerbosityCache* verbosity = detail::VerbosityCache::Disabled();
+};
+static_assert(std::is_trivially_copyable_v<Channel>);
+
+/**
+ * @brief Returns the channel with the given name, creating it and the
+ * "main" client if needed.
+ *
+ * Each thread caches the channels it looked up, so repeated lookups of a
+ * name cost a hash and a string comparison, without locking.  Returns a
+ * disabled channel if logging is disabled, which is kept for the rest of
+ * the process like any other.
+ */
+Channel GetChannel(const std::string_view name);
+
+} /* namespace logging */
+
+#endif /* SRC_LOGGERV2_CHANNEL_HPP_ */
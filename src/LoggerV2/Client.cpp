@@ -678,4 +678,6 @@ Client::~Client() noexcept {
   }
 }
 
+bool Client::LoggingEnabled() { return absl::GetFlag(FLAGS_logging).enabled; }
+
 } /* namespace logging */
@@ -291,6 +291,12 @@ class Client {
 
   IP7_Client* client() { return client_; }
 
+  /**
+   * @brief Returns false if --logging=false turned P7 off.  Channels are
+   * then left disabled, so that messages are dropped before formatting.
+   */
+  static bool LoggingEnabled();
+
  private:
   void RegisterUnixCrashHandlers();
   void RegisterWindowsCrashHandlers();
@@ -0,0 +1,160 @@
+/******************************************************************************
+ * Coalesce.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/Coalesce.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <string_view>
+
+#include <fmt/chrono.h>
+#include <fmt/format.h>
+
+#include "P7_Trace.h"
+
+namespace logging::detail {
+
+namespace {
+
+using Clock = std::chrono::system_clock;
+
+inline std::uint64_t Mix(std::uint64_t hash) noexcept {
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 29;
+  return hash;
+}
+
+/* Hashes eight bytes at a time, as the payload is hashed on every call. */
+std::uint64_t Hash(const CustomSourceLocation& loc, const Level level,
+                   const IP7_Trace::hModule module,
+                   const MessageBuffer& message) noexcept {
+  std::uint64_t hash =
+      Mix(reinterpret_cast<std::uintptr_t>(loc.file_name()) ^
+          (static_cast<std::uint64_t>(loc.line()) << 32) ^
+          (static_cast<std::uint64_t>(level) << 24)) ^
+      reinterpret_cast<std::uintptr_t>(module);
+  const char* data = message.data();
+  std::size_t size = message.size();
+  for (; size >= sizeof(std::uint64_t); size -= sizeof(std::uint64_t)) {
+    std::uint64_t word = 0;
+    std::memcpy(&word, data, sizeof(word));
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 32;
+    data += sizeof(word);
+  }
+  std::uint64_t tail = message.size();
+  std::memcpy(&tail, data, size);
+  return Mix(hash ^ tail);
+}
+
+thread_local Streak local_streak;
+
+void AppendTime(MessageBuffer& message, const Clock::time_point time) {
+  const std::time_t seconds = Clock::to_time_t(time);
+  const auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                          time.time_since_epoch()) %
+                      1000;
+  fmt::format_to(std::back_inserter(message), "{:%H:%M:%S}.{:03}",
+                 fmt::localtime(seconds), millis.count());
+}
+
+} /* namespace */
+
+void Streak::Flush() {
+  if (repeats_ == 0) {
+    return;
+  }
+  MessageBuffer message;
+  fmt::format_to(std::back_inserter(message),
+                 "Last message repeated {} times between ", repeats_);
+  AppendTime(message, first_);
+  fmt::format_to(std::back_inserter(message), " and ");
+  AppendTime(message, last_);
+  TraceMessage(trace_, level_, id_, module_, loc_, message, wrap_);
+  trace_->Release();
+  repeats_ = 0;
+  hash_ = 0;
+}
+
+void Streak::FlushExpired() {
+  if (repeats_ != 0 &&
+      Clock::now() - last_ > std::chrono::nanoseconds(window_)) {
+    Flush();
+  }
+}
+
+void CoalesceMessage(Streak& streak, IP7_Trace* trace, const Level level,
+                     const std::uint16_t id, const IP7_Trace::hModule module,
+                     const CustomSourceLocation& loc, MessageBuffer& message,
+                     const std::int64_t window, const WrapPolicy wrap) {
+  const std::uint64_t hash = Hash(loc, level, module, message);
+  const std::string_view payload(message.data(), message.size());
+  const Clock::time_point now = Clock::now();
+  if (hash == streak.hash_ && trace == streak.trace_ &&
+      now - streak.last_ <= std::chrono::nanoseconds(window) &&
+      level == streak.level_ && module == streak.module_ &&
+      loc.file_name() == streak.loc_.file_name() &&
+      loc.line() == streak.loc_.line() && payload == streak.payload_) {
+    if (streak.repeats_++ == 0) {
+      trace->Add_Ref();
+      streak.first_ = now;
+    }
+    streak.last_ = now;
+    streak.window_ = window;
+    return;
+  }
+
+  streak.Flush();
+  streak.trace_ = trace;
+  streak.module_ = module;
+  streak.loc_ = loc;
+  streak.hash_ = hash;
+  streak.payload_.assign(payload);
+  streak.window_ = window;
+  streak.last_ = now;
+  streak.id_ = id;
+  streak.level_ = level;
+  streak.wrap_ = wrap;
+  TraceMessage(trace, level, id, module, loc, message, wrap);
+}
+
+void CoalesceMessage(IP7_Trace* trace, const Level level,
+                     const std::uint16_t id, const IP7_Trace::hModule module,
+                     const CustomSourceLocation& loc, MessageBuffer& message,
+                     const std::int64_t window, const WrapPolicy wrap) {
+  CoalesceMessage(local_streak, trace, level, id, module, loc, message, window,
+                  wrap);
+  repeats_pending = local_streak.pending();
+}
+
+void FlushCoalesced() {
+  local_streak.Flush();
+  repeats_pending = false;
+}
+
+void FlushExpiredLocal() {
+  local_streak.FlushExpired();
+  repeats_pending = local_streak.pending();
+}
+
+} /* namespace logging::detail */
@@ -0,0 +1,129 @@
+/******************************************************************************
+ * Coalesce.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_COALESCE_HPP_
+#define SRC_LOGGERV2_COALESCE_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "P7_Trace.h"
+
+#include "LoggerV2/CustomSourceLocation.hpp"
+#include "LoggerV2/Message.hpp"
+
+namespace logging::detail {
+
+/**
+ * @brief The repeats of the last message of one producer: a thread in
+ * synchronous mode, or a thread's queue in asynchronous mode.  Holds a
+ * reference to the channel while there are repeats to report.
+ */
+class Streak {
+ public:
+  Streak() noexcept = default;
+  ~Streak() { Flush(); }
+
+  Streak(const Streak& rhs) = delete;
+  Streak& operator=(const Streak& rhs) = delete;
+
+  /** @brief Sends the summary of the repeats, if any */
+  void Flush();
+
+  /** @brief Sends the summary of the repeats if their window has passed */
+  void FlushExpired();
+
+  /** @brief Returns true if there are repeats to report */
+  inline bool pending() const noexcept { return repeats_ != 0; }
+
+ private:
+  friend void CoalesceMessage(Streak& streak, IP7_Trace* trace,
+                              const Level level, const std::uint16_t id,
+                              const IP7_Trace::hModule module,
+                              const CustomSourceLocation& loc,
+                              MessageBuffer& message,
+                              const std::int64_t window,
+                              const WrapPolicy wrap);
+
+  IP7_Trace* trace_ = nullptr;
+  IP7_Trace::hModule module_ = nullptr;
+  CustomSourceLocation loc_;
+  std::uint64_t hash_ = 0;
+  /* Payload of the last message, compared when the hashes match */
+  std::string payload_;
+  std::uint64_t repeats_ = 0;
+  std::int64_t window_ = 0;
+  std::chrono::system_clock::time_point first_;
+  std::chrono::system_clock::time_point last_;
+  std::uint16_t id_ = 0;
+  Level level_ = Level::TRACE;
+  WrapPolicy wrap_;
+};
+
+/**
+ * @brief Sends a formatted message through a producer's coalescing stage.
+ *
+ * The streak remembers a hash of the call site, level, module and payload
+ * of the producer's last message, and a copy of the payload.  A message with
+ * the same hash, sent within the window of the previous one, is compared in
+ * full, and only increments a repeat count if it is the same.
+ * The streak ends when a different message arrives, when the producer
+ * sends any message after the window has passed, or when the producer
+ * exits.  One summary line is then sent with the repeat count and the
+ * times of the first and last repeats.
+ *
+ * @param window Longest gap between repeats, in nanoseconds
+ * @param wrap Wrap policy of the channel, also used for the summary line
+ */
+void CoalesceMessage(Streak& streak, IP7_Trace* trace, const Level level,
+                     const std::uint16_t id, const IP7_Trace::hModule module,
+                     const CustomSourceLocation& loc, MessageBuffer& message,
+                     const std::int64_t window, const WrapPolicy wrap);
+
+/** @brief CoalesceMessage on the calling thread's streak */
+void CoalesceMessage(IP7_Trace* trace, const Level level,
+                     const std::uint16_t id, const IP7_Trace::hModule module,
+                     const CustomSourceLocation& loc, MessageBuffer& message,
+                     const std::int64_t window, const WrapPolicy wrap);
+
+/* Set while the calling thread's streak has repeats to report.  constinit
+ * spares the TLS init check on every access. */
+inline constinit thread_local bool repeats_pending = false;
+
+/** @brief Sends the summary of the calling thread's repeats, if any */
+void FlushCoalesced();
+
+/* Out of line part of FlushExpiredCoalesced */
+void FlushExpiredLocal();
+
+/**
+ * @brief Sends the summary of the calling thread's repeats if their window
+ * has passed.  Called before each message the thread sends, so that the
+ * summary is not held back by messages that are not coalesced.
+ */
+inline void FlushExpiredCoalesced() {
+  if (repeats_pending) [[unlikely]] {
+    FlushExpiredLocal();
+  }
+}
+
+} /* namespace logging::detail */
+
+#endif /* SRC_LOGGERV2_COALESCE_HPP_ */
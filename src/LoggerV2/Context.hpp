@@ -0,0 +1,126 @@
+/******************************************************************************
+ * Context.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_CONTEXT_HPP_
+#define SRC_LOGGERV2_CONTEXT_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "LoggerV2/Field.hpp"
+
+namespace logging {
+
+namespace detail {
+
+/* Context of one thread, encoded like fields and appended to each of its
+ * messages.  Entries that do not fit in kContextSize bytes are dropped. */
+struct Context {
+  std::uint32_t size = 0;
+  std::array<char, kContextSize> data{};
+};
+/* constinit spares the TLS init check on every access. */
+inline constinit thread_local Context context;
+
+/** @brief Appends the context of the calling thread to encoded fields */
+inline void AppendContext(FieldBuffer& fields) {
+  if (context.size != 0) {
+    fields.append(context.data.data(), context.data.data() + context.size);
+  }
+}
+
+/**
+ * @brief Encodes fields in place at the end of a context.  A write that
+ * does not fit is dropped, along with everything after it, and marks the
+ * writer as overflowed.
+ */
+class ContextWriter {
+ public:
+  using value_type = char;
+
+  explicit ContextWriter(Context& target) noexcept
+      : target_(target), size_(target.size) {}
+
+  char* data() noexcept { return target_.data.data(); }
+  std::size_t size() const noexcept { return size_; }
+  bool overflowed() const noexcept { return overflowed_; }
+
+  void push_back(const char c) noexcept {
+    if (!overflowed_ && size_ < kContextSize) {
+      target_.data[size_++] = c;
+    } else {
+      overflowed_ = true;
+    }
+  }
+  void append(const char* begin, const char* end) noexcept {
+    const auto count = static_cast<std::size_t>(end - begin);
+    if (!overflowed_ && count <= kContextSize - size_) {
+      std::memcpy(target_.data.data() + size_, begin, count);
+      size_ += count;
+    } else {
+      overflowed_ = true;
+    }
+  }
+
+ private:
+  Context& target_;
+  std::size_t size_;
+  bool overflowed_ = false;
+};
+
+} /* namespace detail */
+
+/**
+ * @brief Attaches a field to every message the calling thread sends while
+ * it is alive:
+ * @code
+ * logging::ScopedContext request("req", request_id);
+ * logging::ScopedContext tenant("tenant", tenant_name);
+ * log.Info("handled");  // handled | req=42 tenant=acme
+ * @endcode
+ * Values are encoded like those of kv straight into a fixed thread-local
+ * buffer, so pushing and popping never allocate.  Contexts must be
+ * destroyed in reverse order of creation, which scoping guarantees.
+ */
+class ScopedContext {
+ public:
+  template <typename T>
+  ScopedContext(const FieldKey key, const T& value)
+      : previous_(detail::context.size) {
+    detail::ContextWriter writer(detail::context);
+    detail::EncodeValue(writer, key, value);
+    if (!writer.overflowed()) {
+      detail::context.size = static_cast<std::uint32_t>(writer.size());
+    }
+  }
+  ~ScopedContext() noexcept { detail::context.size = previous_; }
+
+  ScopedContext(const ScopedContext& rhs) = delete;
+  ScopedContext& operator=(const ScopedContext& rhs) = delete;
+
+ private:
+  std::uint32_t previous_;
+};
+
+} /* namespace logging */
+
+#endif /* SRC_LOGGERV2_CONTEXT_HPP_ */
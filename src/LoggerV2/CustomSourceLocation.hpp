@@ -20,6 +20,8 @@
 #ifndef SRC_LOGGERV2_CUSTOMSOURCELOCATION_HPP_
 #define SRC_LOGGERV2_CUSTOMSOURCELOCATION_HPP_
 
+#include <cstdint>
+
 #ifndef __has_builtin
 #define __has_builtin(x) 0  // Compatibility with non-clang compilers.
 #endif
@@ -35,7 +37,8 @@ struct CustomSourceLocation {
   constexpr CustomSourceLocation() noexcept
       : file_("unknown"), func_(file_), line_(0), col_(0) {}
 
-  // 14.1.2, source_location creation
+  // 14.1.2, source_location creation.  File names are shortened by the
+  // compiler, see LOG_FILE_NAMES.
   static constexpr CustomSourceLocation current(
 #if __has_builtin(__builtin_FILE)
       const char* __file = __builtin_FILE(),
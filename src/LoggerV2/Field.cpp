@@ -0,0 +1,211 @@
+/******************************************************************************
+ * Field.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/Field.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+#include <fmt/compile.h>
+#include <fmt/format.h>
+
+namespace logging {
+
+namespace detail {
+
+namespace {
+
+/* Reads the fields encoded by EncodeValue, in order. */
+class FieldReader {
+ public:
+  explicit FieldReader(const std::string_view fields) noexcept
+      : fields_(fields) {}
+
+  bool Done() const noexcept { return offset_ >= fields_.size(); }
+
+  template <typename T>
+  T Read() noexcept {
+    T value;
+    std::memcpy(&value, fields_.data() + offset_, sizeof(T));
+    offset_ += sizeof(T);
+    return value;
+  }
+
+  std::string_view ReadKey() noexcept {
+    const auto size = Read<std::uint8_t>();
+    return {Read<const char*>(), size};
+  }
+
+  std::string_view ReadString() noexcept {
+    const auto size = Read<std::uint32_t>();
+    const std::string_view string(fields_.data() + offset_, size);
+    offset_ += size;
+    return string;
+  }
+
+ private:
+  std::string_view fields_;
+  std::size_t offset_ = 0;
+};
+
+using Out = std::back_insert_iterator<MessageBuffer>;
+
+/* Strings without spaces, quotes or '=' are printed bare, like logfmt. */
+bool NeedsQuotes(const std::string_view value) noexcept {
+  if (value.empty()) {
+    return true;
+  }
+  for (const char c : value) {
+    if (c <= ' ' || c == '"' || c == '=' || c == '\\' || c == 0x7F) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Escapes quotes, backslashes and control characters, as JSON does.  Runs
+ * of plain characters are appended at once. */
+void AppendEscaped(MessageBuffer& out, const std::string_view value) {
+  out.push_back('"');
+  std::size_t plain = 0;
+  for (std::size_t i = 0; i < value.size(); ++i) {
+    const char c = value[i];
+    if (c != '"' && c != '\\' && static_cast<unsigned char>(c) >= 0x20) {
+      continue;
+    }
+    out.append(value.substr(plain, i - plain));
+    plain = i + 1;
+    switch (c) {
+      case '"':
+        out.append(std::string_view("\\\""));
+        break;
+      case '\\':
+        out.append(std::string_view("\\\\"));
+        break;
+      case '\n':
+        out.append(std::string_view("\\n"));
+        break;
+      case '\r':
+        out.append(std::string_view("\\r"));
+        break;
+      case '\t':
+        out.append(std::string_view("\\t"));
+        break;
+      default:
+        fmt::format_to(Out(out), "\\u{:04x}", static_cast<unsigned>(c));
+    }
+  }
+  out.append(value.substr(plain));
+  out.push_back('"');
+}
+
+template <typename T>
+void AppendNumber(MessageBuffer& out, const T value, const bool json) {
+  if constexpr (std::is_integral_v<T>) {
+    const fmt::format_int text(value);
+    out.append(text.data(), text.data() + text.size());
+  } else {
+    if (json && !std::isfinite(value)) {
+      out.append(std::string_view("null"));
+      return;
+    }
+    fmt::format_to(Out(out), FMT_COMPILE("{}"), value);
+  }
+}
+
+void AppendValue(FieldReader& reader, const FieldType type,
+                 MessageBuffer& out, const bool json) {
+  switch (type) {
+    case FieldType::kBool:
+      out.append(reader.Read<char>() != 0 ? std::string_view("true")
+                                           : std::string_view("false"));
+      break;
+    case FieldType::kInt:
+      AppendNumber(out, reader.Read<std::int64_t>(), json);
+      break;
+    case FieldType::kUint:
+      AppendNumber(out, reader.Read<std::uint64_t>(), json);
+      break;
+    case FieldType::kFloat:
+      AppendNumber(out, reader.Read<float>(), json);
+      break;
+    case FieldType::kDouble:
+      AppendNumber(out, reader.Read<double>(), json);
+      break;
+    case FieldType::kString:
+    case FieldType::kText: {
+      const std::string_view value = reader.ReadString();
+      if (json || NeedsQuotes(value)) {
+        AppendEscaped(out, value);
+      } else {
+        out.append(value);
+      }
+      break;
+    }
+  }
+}
+
+} /* namespace */
+
+void RenderFields(const std::string_view fields, MessageBuffer& message) {
+  if (fields.empty()) {
+    return;
+  }
+  FieldReader reader(fields);
+  if (field_format.load(std::memory_order_relaxed) == FieldFormat::kText) {
+    message.append(std::string_view(" |"));
+    while (!reader.Done()) {
+      const auto type = reader.Read<FieldType>();
+      message.push_back(' ');
+      message.append(reader.ReadKey());
+      message.push_back('=');
+      AppendValue(reader, type, message, false);
+    }
+    return;
+  }
+
+  MessageBuffer json;
+  json.append(std::string_view("{\"msg\":"));
+  AppendEscaped(json, std::string_view(message.data(), message.size()));
+  while (!reader.Done()) {
+    const auto type = reader.Read<FieldType>();
+    json.push_back(',');
+    AppendEscaped(json, reader.ReadKey());
+    json.push_back(':');
+    AppendValue(reader, type, json, true);
+  }
+  json.push_back('}');
+  message = std::move(json);
+}
+
+} /* namespace detail */
+
+void SetFieldFormat(const FieldFormat format) noexcept {
+  detail::field_format.store(format, std::memory_order_relaxed);
+}
+
+FieldFormat GetFieldFormat() noexcept {
+  return detail::field_format.load(std::memory_order_relaxed);
+}
+
+} /* namespace logging */
@@ -0,0 +1,261 @@
+/******************************************************************************
+ * Field.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_FIELD_HPP_
+#define SRC_LOGGERV2_FIELD_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+#include <fmt/format.h>
+
+#include "LoggerV2/Lazy.hpp"
+#include "LoggerV2/Message.hpp"
+
+namespace logging {
+
+/**
+ * @brief How structured fields are rendered when a message is sent
+ */
+enum class FieldFormat : std::uint8_t {
+  kText, /**< @brief request done | latency_us=42 status=ok */
+  kJson  /**< @brief {"msg":"request done","latency_us":42,"status":"ok"} */
+};
+
+/** @brief Sets the rendering of structured fields for every channel */
+void SetFieldFormat(const FieldFormat format) noexcept;
+FieldFormat GetFieldFormat() noexcept;
+
+/**
+ * @brief Key of a structured field.  Only string literals of letters,
+ * digits, '_', '.' and '-' are accepted, and they are checked at compile
+ * time.  The key is not copied, so it must outlive the process' messages.
+ */
+class FieldKey {
+ public:
+  static inline constexpr std::size_t kMaxSize = UINT8_MAX;
+
+  template <std::size_t N>
+  FMT_CONSTEVAL FieldKey(const char (&key)[N]) : data_(key), size_(N - 1) {
+    static_assert(N > 1, "Field keys may not be empty");
+    static_assert(N - 1 <= kMaxSize, "Field keys are at most 255 characters");
+    for (std::size_t i = 0; i < N - 1; ++i) {
+      const char c = key[i];
+      if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+            (c >= '0' && c <= '9') || c == '_' || c == '.' || c == '-')) {
+        InvalidKey();
+      }
+    }
+  }
+
+  constexpr std::string_view view() const noexcept { return {data_, size_}; }
+  constexpr const char* data() const noexcept { return data_; }
+  constexpr std::uint8_t size() const noexcept { return size_; }
+
+ private:
+  /* Not constexpr, so that an invalid key fails to compile. */
+  static void InvalidKey() {
+    throw std::invalid_argument("Invalid character in log field key");
+  }
+
+  const char* data_;
+  std::uint8_t size_;
+};
+
+/**
+ * @brief A key and value passed to a Log function after the format
+ * arguments.  Created with kv.
+ */
+template <typename T>
+struct Field {
+  FieldKey key;
+  const T& value;
+};
+
+/**
+ * @brief Attaches a structured field to a message:
+ * @code
+ * log.Info("request done", logging::kv("latency_us", us),
+ *          logging::kv("status", status));
+ * @endcode
+ * Fields follow the format arguments and are not referenced by the format.
+ * Numbers, booleans and strings are copied in binary form, and rendered as
+ * text or JSON (see SetFieldFormat) when the message is sent, which is on
+ * the background thread in asynchronous mode.  Values of other types are
+ * formatted with fmt on the calling thread.  Lazy values are evaluated
+ * when the message passes the verbosity check.
+ */
+template <typename T>
+constexpr Field<T> kv(const FieldKey key, const T& value) noexcept {
+  return Field<T>{key, value};
+}
+
+namespace detail {
+
+inline std::atomic<FieldFormat> field_format{FieldFormat::kText};
+
+/* Size of the context of a thread, see ScopedContext */
+inline constexpr std::size_t kContextSize = 512;
+/* The context and the fields of typical messages are encoded without
+ * allocating. */
+inline constexpr std::size_t kFieldBufferSize = kContextSize + 128;
+using FieldBuffer = fmt::basic_memory_buffer<char, kFieldBufferSize>;
+
+/**
+ * @brief Type tag of an encoded field.  Each field is encoded as the tag,
+ * the key size, the key pointer and the value, without padding.  Numbers
+ * are stored in native byte order, strings and text as a 32 bit size
+ * followed by the characters.
+ */
+enum class FieldType : std::uint8_t {
+  kBool,
+  kInt,    /**< @brief std::int64_t */
+  kUint,   /**< @brief std::uint64_t */
+  kFloat,  /**< @brief float, rendered with its own shortest form */
+  kDouble, /**< @brief double */
+  kString, /**< @brief Characters, quoted if needed when rendered */
+  kText    /**< @brief Value formatted by fmt on the calling thread */
+};
+
+template <typename T>
+inline constexpr bool kIsField = false;
+template <typename T>
+inline constexpr bool kIsField<Field<T>> = true;
+
+/** @brief Number of fields among the arguments of a Log call */
+template <typename... Args>
+inline constexpr std::size_t kFieldCount =
+    (std::size_t{0} + ... + std::size_t{kIsField<Args>});
+
+/** @brief True if no format argument follows a field */
+template <typename... Args>
+constexpr bool FieldsLast() noexcept {
+  bool field = false;
+  bool last = true;
+  ((last = last && (!field || kIsField<Args>), field = kIsField<Args>), ...);
+  return last;
+}
+
+/* The encoding functions take a FieldBuffer, or anything else with its
+ * data, size, push_back and append, such as ContextWriter. */
+
+template <typename Buffer, typename T>
+void AppendBytes(Buffer& fields, const T& value) {
+  const char* const bytes = reinterpret_cast<const char*>(&value);
+  fields.append(bytes, bytes + sizeof(T));
+}
+
+template <typename Buffer>
+void AppendHeader(Buffer& fields, const FieldType type, const FieldKey key) {
+  fields.push_back(static_cast<char>(type));
+  fields.push_back(static_cast<char>(key.size()));
+  AppendBytes(fields, key.data());
+}
+
+template <typename Buffer>
+void AppendString(Buffer& fields, const std::string_view value) {
+  AppendBytes(fields, static_cast<std::uint32_t>(value.size()));
+  fields.append(value.data(), value.data() + value.size());
+}
+
+/** @brief Appends one field to the buffer */
+template <typename Buffer, typename T>
+void EncodeValue(Buffer& fields, const FieldKey key, const T& value) {
+  if constexpr (kIsLazy<T>) {
+    EncodeValue(fields, key, Evaluate(value));
+  } else if constexpr (std::is_same_v<T, bool>) {
+    AppendHeader(fields, FieldType::kBool, key);
+    fields.push_back(value ? '\1' : '\0');
+  } else if constexpr (std::is_same_v<T, char>) {
+    AppendHeader(fields, FieldType::kString, key);
+    AppendString(fields, std::string_view(&value, 1));
+  } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    AppendHeader(fields, FieldType::kInt, key);
+    AppendBytes(fields, static_cast<std::int64_t>(value));
+  } else if constexpr (std::is_integral_v<T>) {
+    AppendHeader(fields, FieldType::kUint, key);
+    AppendBytes(fields, static_cast<std::uint64_t>(value));
+  } else if constexpr (std::is_same_v<T, float>) {
+    AppendHeader(fields, FieldType::kFloat, key);
+    AppendBytes(fields, value);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    AppendHeader(fields, FieldType::kDouble, key);
+    AppendBytes(fields, static_cast<double>(value));
+  } else if constexpr (std::is_same_v<T, const char*> ||
+                       std::is_same_v<T, char*>) {
+    AppendHeader(fields, FieldType::kString, key);
+    AppendString(fields, value != nullptr ? std::string_view(value)
+                                          : std::string_view("(null)"));
+  } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+    AppendHeader(fields, FieldType::kString, key);
+    AppendString(fields, std::string_view(value));
+  } else {
+    AppendHeader(fields, FieldType::kText, key);
+    const std::size_t size_offset = fields.size();
+    AppendBytes(fields, std::uint32_t{0});
+    fmt::format_to(std::back_inserter(fields), "{}", value);
+    /* A buffer that drops what does not fit may not hold the size */
+    if (fields.size() >= size_offset + sizeof(std::uint32_t)) {
+      const auto size = static_cast<std::uint32_t>(fields.size() -
+                                                   size_offset - 4);
+      std::memcpy(fields.data() + size_offset, &size, sizeof(size));
+    }
+  }
+}
+
+/** @brief Encodes a Log argument if it is a field, and skips it otherwise */
+template <typename Buffer, typename T>
+void EncodeField(Buffer& fields, const T& arg) {
+  if constexpr (kIsField<T>) {
+    EncodeValue(fields, arg.key, arg.value);
+  }
+}
+
+/**
+ * @brief Renders encoded fields into a formatted message, in the format set
+ * by SetFieldFormat
+ */
+void RenderFields(const std::string_view fields, MessageBuffer& message);
+
+} /* namespace detail */
+
+} /* namespace logging */
+
+/* A field referenced by the format is printed as key=value. */
+template <typename T, typename Char>
+struct fmt::formatter<logging::Field<T>, Char> : fmt::formatter<T, Char> {
+  template <typename FormatContext>
+  auto format(const logging::Field<T>& field, FormatContext& ctx) {
+    ctx.advance_to(fmt::format_to(ctx.out(), "{}=", field.key.view()));
+    return fmt::formatter<T, Char>::format(field.value, ctx);
+  }
+  template <typename FormatContext>
+  auto format(const logging::Field<T>& field, FormatContext& ctx) const {
+    ctx.advance_to(fmt::format_to(ctx.out(), "{}=", field.key.view()));
+    return fmt::formatter<T, Char>::format(field.value, ctx);
+  }
+};
+
+#endif /* SRC_LOGGERV2_FIELD_HPP_ */
@@ -0,0 +1,333 @@
+/******************************************************************************
+ * FormatString.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_FORMATSTRING_HPP_
+#define SRC_LOGGERV2_FORMATSTRING_HPP_
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#include <fmt/compile.h>
+#include <fmt/format.h>
+
+#include "LoggerV2/Message.hpp"
+
+namespace logging {
+
+namespace detail {
+
+/**
+ * @brief A string literal usable as a template argument
+ */
+template <std::size_t N>
+struct FixedString {
+  constexpr FixedString(const char (&text)[N]) noexcept {
+    for (std::size_t i = 0; i < N; ++i) {
+      value[i] = text[i];
+    }
+  }
+  constexpr std::string_view view() const noexcept { return {value, N - 1}; }
+
+  char value[N]{};
+};
+
+/**
+ * @brief A format string known at compile time.  Created with the _log
+ * literal.
+ */
+template <FixedString kText>
+struct StaticFormat {};
+
+/**
+ * @brief Returns the printf conversion P7 uses to encode an argument of type
+ * T, or nullptr if P7 cannot encode it.  Arguments narrower than int are
+ * promoted when passed to P7, so they use the int conversions.  Arrays decay
+ * to pointers.
+ */
+template <typename T>
+constexpr const char* NativeSpec() noexcept {
+  using U = std::decay_t<T>;
+  if constexpr (std::is_same_v<U, bool>) {
+    return nullptr;
+  } else if constexpr (std::is_same_v<U, char>) {
+    return "c";
+  } else if constexpr (std::is_same_v<U, signed char> ||
+                       std::is_same_v<U, short> || std::is_same_v<U, int>) {
+    return "d";
+  } else if constexpr (std::is_same_v<U, unsigned char> ||
+                       std::is_same_v<U, unsigned short> ||
+                       std::is_same_v<U, unsigned int>) {
+    return "u";
+  } else if constexpr (std::is_same_v<U, long>) {
+    return "ld";
+  } else if constexpr (std::is_same_v<U, unsigned long>) {
+    return "lu";
+  } else if constexpr (std::is_same_v<U, long long>) {
+    return "lld";
+  } else if constexpr (std::is_same_v<U, unsigned long long>) {
+    return "llu";
+  } else if constexpr (std::is_same_v<U, float> || std::is_same_v<U, double>) {
+    return "g";
+  } else if constexpr (std::is_same_v<U, const char*> ||
+                       std::is_same_v<U, char*>) {
+    return "s";
+  } else if constexpr (std::is_same_v<U, const void*> ||
+                       std::is_same_v<U, void*>) {
+    return "p";
+  } else {
+    return nullptr;
+  }
+}
+
+/** @brief True if P7 can encode every argument */
+template <typename... Args>
+inline constexpr bool kNativeArgs = ((NativeSpec<Args>() != nullptr) && ...);
+
+/**
+ * @brief The printf-style translation of a format string, sent to P7 with
+ * the binary arguments instead of formatting the message.
+ */
+template <std::size_t N>
+struct NativeTranslation {
+  std::array<char, N> text{};
+  bool valid = false;
+};
+
+/**
+ * @brief Translates a format to P7's printf style at compile time.
+ *
+ * Only plain {} replacement fields and the {{ and }} escapes are translated.
+ * Formats with format specs, argument indices or newlines, and arguments P7
+ * cannot encode, are left to fmt.
+ */
+template <FixedString kText, typename... Args>
+struct NativeFormat {
+  static constexpr std::size_t kSize =
+      2 * kText.view().size() + 4 * sizeof...(Args) + 1;
+
+  static constexpr NativeTranslation<kSize> Translate() noexcept {
+    NativeTranslation<kSize> result;
+    if constexpr (kNativeArgs<Args...>) {
+      constexpr std::array<const char*, sizeof...(Args)> specs{
+          NativeSpec<Args>()...};
+      constexpr std::string_view text = kText.view();
+      std::size_t out = 0;
+      std::size_t arg = 0;
+      for (std::size_t i = 0; i < text.size(); ++i) {
+        const char c = text[i];
+        const char next = i + 1 < text.size() ? text[i + 1] : '\0';
+        if (c == '{' && next == '{') {
+          result.text[out++] = '{';
+          ++i;
+        } else if (c == '{' && next == '}') {
+          if (arg == specs.size()) {
+            return result;
+          }
+          result.text[out++] = '%';
+          for (const char* spec = specs[arg++]; *spec != '\0'; ++spec) {
+            result.text[out++] = *spec;
+          }
+          ++i;
+        } else if (c == '}' && next == '}') {
+          result.text[out++] = '}';
+          ++i;
+        } else if (c == '{' || c == '}' || c == '\n' || c == '\0') {
+          return result;
+        } else if (c == '%') {
+          result.text[out++] = '%';
+          result.text[out++] = '%';
+        } else {
+          result.text[out++] = c;
+        }
+      }
+      result.valid = arg == specs.size();
+    }
+    return result;
+  }
+
+  static constexpr NativeTranslation<kSize> kTranslation = Translate();
+
+  /** @brief Returns the translated format, or nullptr if there is none */
+  static constexpr const char* Get() noexcept {
+    return kTranslation.valid ? kTranslation.text.data() : nullptr;
+  }
+};
+
+/* fmt 9 moved the base of compiled format strings into fmt::detail. */
+#if FMT_VERSION >= 90000
+using CompiledStringBase = fmt::detail::compiled_string;
+#else  /* FMT_VERSION >= 90000 */
+using CompiledStringBase = fmt::compiled_string;
+#endif /* FMT_VERSION >= 90000 */
+
+/**
+ * @brief Wraps a _log format so that fmt parses it at compile time
+ */
+template <FixedString kText>
+struct CompiledText : CompiledStringBase {
+  using char_type = char;
+  explicit constexpr operator fmt::string_view() const noexcept {
+    return {kText.value, kText.view().size()};
+  }
+};
+
+/* Formats the arguments of a _log format, values being a tuple of
+ * references to them. */
+template <FixedString kText, typename... Args>
+void FormatCompiled(MessageBuffer& message, const void* values) {
+  std::apply(
+      [&](const Args&... all) {
+        fmt::format_to(std::back_inserter(message), CompiledText<kText>{},
+                       all...);
+      },
+      *static_cast<const std::tuple<const Args&...>*>(values));
+}
+
+/**
+ * @brief A format and its arguments with their types erased, so that one
+ * function formats the messages of every call site.  Refers to the
+ * arguments, so it must not outlive them.
+ */
+struct ErasedFormat {
+  std::string_view text;
+  fmt::format_args args;
+  /* Formatter of a _log format, called with the tuple of references its
+   * arguments were erased from, or nullptr */
+  void (*compiled)(MessageBuffer& message, const void* values);
+  const void* values;
+
+  /**
+   * @brief Appends the formatted message to the buffer.  May throw
+   * fmt::format_error for runtime formats.
+   */
+  void Format(MessageBuffer& message) const {
+    if (compiled != nullptr) {
+      compiled(message, values);
+    } else {
+      fmt::vformat_to(std::back_inserter(message), text, args);
+    }
+  }
+};
+
+/**
+ * @brief A format string that is only known at runtime.  Created with
+ * RuntimeFormat.
+ */
+struct RuntimeFormatString {
+  std::string_view text;
+};
+
+/**
+ * @brief Format string parameter of the Log functions
+ *
+ * String literals are checked against the argument types at compile time,
+ * so a wrong number of arguments or an invalid format is a build error.
+ * Formats created with the _log literal are also parsed at compile time,
+ * and carry the P7 translation matching the argument types.
+ */
+template <typename... Args>
+class BasicFormatString {
+ public:
+  template <typename S, typename = std::enable_if_t<
+                            std::is_convertible_v<const S&, std::string_view>>>
+  FMT_CONSTEVAL BasicFormatString(const S& text) : text_(text) {
+    [[maybe_unused]] const fmt::format_string<Args...> checked(text);
+  }
+  template <FixedString kText>
+  FMT_CONSTEVAL BasicFormatString(StaticFormat<kText> /*unused*/)
+      : text_(kText.view()),
+        native_(NativeFormat<kText, Args...>::Get()),
+        compiled_(&FormatCompiled<kText, Args...>) {
+    [[maybe_unused]] const fmt::format_string<Args...> checked(text_);
+  }
+  constexpr BasicFormatString(const RuntimeFormatString runtime) noexcept
+      : text_(runtime.text) {}
+
+  constexpr std::string_view text() const noexcept { return text_; }
+  /** @brief Returns the P7 translation, or nullptr if there is none */
+  constexpr const char* native() const noexcept { return native_; }
+
+  /**
+   * @brief Erases the types of a call's arguments, see ErasedFormat
+   *
+   * @param args The arguments, from fmt::make_format_args
+   * @param values References to the same arguments
+   */
+  ErasedFormat Erase(const fmt::format_args args,
+                     const std::tuple<const Args&...>& values) const noexcept {
+    return ErasedFormat{text_, args, compiled_, &values};
+  }
+
+  /**
+   * @brief Appends the formatted message to the buffer.  May throw
+   * fmt::format_error for runtime formats.
+   */
+  void Format(MessageBuffer& message, const Args&... all) const {
+    const std::tuple<const Args&...> values(all...);
+    Erase(fmt::make_format_args(all...), values).Format(message);
+  }
+
+ private:
+  std::string_view text_;
+  const char* native_ = nullptr;
+  void (*compiled_)(MessageBuffer& message, const void* values) = nullptr;
+};
+
+} /* namespace detail */
+
+/* The argument types are not deduced from the format string. */
+template <typename... Args>
+using FormatString = detail::BasicFormatString<std::type_identity_t<Args>...>;
+
+/**
+ * @brief Passes a format string built at runtime to a Log function.  It is
+ * not checked at compile time, and an invalid format throws
+ * fmt::format_error from the Log call.
+ */
+constexpr detail::RuntimeFormatString RuntimeFormat(
+    const std::string_view format) noexcept {
+  return detail::RuntimeFormatString{format};
+}
+
+namespace literals {
+
+/**
+ * @brief Marks a format string as known at compile time:
+ * @code log.Info("Frame {} took {} ms"_log, frame, ms); @endcode
+ *
+ * If every argument is an integer, floating point number, C string or
+ * pointer, and the format only uses plain {} fields, the message is sent to
+ * P7 as binary arguments and formatted by Baical, instead of being formatted
+ * by fmt on the calling thread.  Such messages are not split at the line
+ * wrap length, and floating point numbers are printed with printf's %g.
+ */
+template <detail::FixedString kText>
+constexpr detail::StaticFormat<kText> operator""_log() noexcept {
+  return {};
+}
+
+} /* namespace literals */
+
+} /* namespace logging */
+
+#endif /* SRC_LOGGERV2_FORMATSTRING_HPP_ */
@@ -0,0 +1,121 @@
+/******************************************************************************
+ * Lazy.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_LAZY_HPP_
+#define SRC_LOGGERV2_LAZY_HPP_
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include <boost/preprocessor/cat.hpp>
+#include <fmt/format.h>
+
+#include "LoggerV2/Message.hpp"
+#include "LoggerV2/RateLimit.hpp"
+
+namespace logging {
+
+/**
+ * @brief A log argument computed only if the message is sent.  Created with
+ * lazy.
+ */
+template <typename F>
+struct Lazy {
+  F function;
+};
+
+/**
+ * @brief Defers an expensive log argument until the message passes the
+ * verbosity check:
+ * @code
+ * log.Debug("State {}", logging::lazy([&] { return Dump(state); }));
+ * @endcode
+ * The callable is invoked on the calling thread, at most once per message,
+ * also when the message is queued by the asynchronous mode.
+ */
+template <typename F>
+constexpr Lazy<std::decay_t<F>> lazy(F&& function) {
+  return Lazy<std::decay_t<F>>{std::forward<F>(function)};
+}
+
+namespace detail {
+
+template <typename T>
+inline constexpr bool kIsLazy = false;
+template <typename F>
+inline constexpr bool kIsLazy<Lazy<F>> = true;
+
+/** @brief Invokes a lazy argument, other arguments are passed through */
+template <typename T>
+decltype(auto) Evaluate(const T& value) {
+  if constexpr (kIsLazy<T>) {
+    return std::decay_t<decltype(std::invoke(value.function))>(
+        std::invoke(value.function));
+  } else {
+    return (value);
+  }
+}
+
+/** @brief Type a lazy argument is replaced with, other types are kept */
+template <typename T>
+using Evaluated = std::decay_t<decltype(Evaluate(std::declval<const T&>()))>;
+
+} /* namespace detail */
+
+} /* namespace logging */
+
+/* Lazy arguments take the format specs of the type their callable returns. */
+template <typename F, typename Char>
+struct fmt::formatter<logging::Lazy<F>, Char>
+    : fmt::formatter<std::decay_t<std::invoke_result_t<const F&>>, Char> {
+  using Base =
+      fmt::formatter<std::decay_t<std::invoke_result_t<const F&>>, Char>;
+
+  template <typename FormatContext>
+  auto format(const logging::Lazy<F>& lazy, FormatContext& ctx) {
+    return Base::format(std::invoke(lazy.function), ctx);
+  }
+  template <typename FormatContext>
+  auto format(const logging::Lazy<F>& lazy, FormatContext& ctx) const {
+    return Base::format(std::invoke(lazy.function), ctx);
+  }
+};
+
+/**
+ * @brief Log call that does not evaluate its arguments unless the channel or
+ * one of its modules lets the level through:
+ * @code
+ * LOG_LAZY(log, Debug, mh, "Queue {}", ToString(queue));
+ * LOG_LAZY(log, SendTrace, Level::INFO, mh, "Checksum {}", Checksum(data));
+ * @endcode
+ */
+// clang-format off
+#define LOG_LAZY(log, method, ...)                                           \
+  do {                                                                       \
+    if (::logging::IsCompiledIn(                                             \
+            BOOST_PP_CAT(LOG_INTERNAL_LEVEL_, method)(__VA_ARGS__)) &&       \
+        (log).IsAnyEnabled(                                                  \
+            BOOST_PP_CAT(LOG_INTERNAL_LEVEL_, method)(__VA_ARGS__))) {       \
+      (log).method(__VA_ARGS__);                                             \
+    }                                                                        \
+  } while (false)
+// clang-format on
+
+#endif /* SRC_LOGGERV2_LAZY_HPP_ */
@@ -0,0 +1,107 @@
+/******************************************************************************
+ * LineSplitter.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/LineSplitter.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* defined(__AVX2__) */
+
+namespace logging::detail {
+
+namespace {
+
+/* Returns the first newline in [begin, end), or end if there is none. */
+const char* FindNewline(const char* begin, const char* const end) noexcept {
+#if defined(__AVX2__)
+  const __m256i newlines = _mm256_set1_epi8('\n');
+  for (; end - begin >= 32; begin += 32) {
+    const __m256i chunk =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+    const std::uint32_t mask = static_cast<std::uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newlines)));
+    if (mask != 0) {
+      return begin + __builtin_ctz(mask);
+    }
+  }
+#endif /* defined(__AVX2__) */
+#if defined(__SSE2__)
+  const __m128i newline = _mm_set1_epi8('\n');
+  for (; end - begin >= 16; begin += 16) {
+    const __m128i chunk =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+    const std::uint32_t mask = static_cast<std::uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+    if (mask != 0) {
+      return begin + __builtin_ctz(mask);
+    }
+  }
+#endif /* defined(__SSE2__) */
+  for (; begin < end; ++begin) {
+    if (*begin == '\n') {
+      return begin;
+    }
+  }
+  return end;
+}
+
+inline bool IsContinuation(const char c) noexcept {
+  return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+} /* namespace */
+
+bool LineSplitter::Next(std::string_view& piece) noexcept {
+  while (position_ < end_) {
+    const char* const limit =
+        position_ + std::min<std::size_t>(wrap_length_, end_ - position_);
+    const char* piece_end =
+        split_lines_ ? FindNewline(position_, limit) : limit;
+    const char* next = piece_end + 1;
+    if (piece_end == limit) {
+      next = limit;
+      /* Wrap before the code point that crosses the wrap length.  Invalid
+       * UTF-8 without a lead byte nearby is cut at the wrap length. */
+      if (limit != end_) {
+        const char* cut = limit;
+        while (cut > position_ && limit - cut < 3 && IsContinuation(*cut)) {
+          --cut;
+        }
+        if (cut > position_ && !IsContinuation(*cut)) {
+          piece_end = next = cut;
+        }
+      }
+    }
+    const char* const begin = position_;
+    position_ = next;
+    if (piece_end != begin) {
+      piece = std::string_view(begin, piece_end - begin);
+      return true;
+    }
+  }
+  return false;
+}
+
+} /* namespace logging::detail */
@@ -0,0 +1,68 @@
+/******************************************************************************
+ * LineSplitter.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_LINESPLITTER_HPP_
+#define SRC_LOGGERV2_LINESPLITTER_HPP_
+
+#include <cstddef>
+#include <string_view>
+
+namespace logging::detail {
+
+/**
+ * @brief Splits a message into the pieces sent to P7
+ *
+ * The message is split at every newline, and lines longer than the wrap
+ * length are wrapped.  Wrapping never cuts a UTF-8 encoded code point in
+ * two, so a piece can be up to three bytes shorter than the wrap length.
+ * Empty lines are skipped.  Each byte is scanned once, 16 or 32 bytes at a
+ * time when SSE2 or AVX2 is available.  Without split_lines, newlines are
+ * kept inside the pieces and only the wrap length cuts the message.
+ * @code
+ * LineSplitter splitter(message, kLineWrapLength);
+ * for (std::string_view piece; splitter.Next(piece);) { ... }
+ * @endcode
+ */
+class LineSplitter {
+ public:
+  LineSplitter(const std::string_view text,
+               const std::size_t wrap_length,
+               const bool split_lines = true) noexcept
+      : position_(text.data()),
+        end_(text.data() + text.size()),
+        wrap_length_(wrap_length),
+        split_lines_(split_lines) {}
+
+  /**
+   * @brief Gets the next piece, which points into the message
+   *
+   * @return false once every piece was returned
+   */
+  bool Next(std::string_view& piece) noexcept;
+
+ private:
+  const char* position_;
+  const char* end_;
+  std::size_t wrap_length_;
+  bool split_lines_;
+};
+
+} /* namespace logging::detail */
+
+#endif /* SRC_LOGGERV2_LINESPLITTER_HPP_ */
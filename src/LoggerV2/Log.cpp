@@ -20,47 +20,96 @@
 
 #include "LoggerV2/Log.hpp"
 
-#include <array>
-#include <iostream>
-#include <stdexcept>
-#include <string>
+#include <cstdint>
+#include <iterator>
 #include <string_view>
-#include <vector>
 
-#include "P7_Trace.h"
+#include <fmt/format.h>
 
-#include "LoggerV2/Client.hpp"
+#include "LoggerV2/Async.hpp"
+#include "LoggerV2/Channel.hpp"
+#include "LoggerV2/Coalesce.hpp"
+#include "LoggerV2/FormatString.hpp"
+#include "LoggerV2/Message.hpp"
+#include "LoggerV2/Redaction.hpp"
 
 namespace logging {
 
-Log::Log(const std::string name) {
-  using namespace std::literals::string_literals;
+Log::Log(const std::string_view name) : Log(GetChannel(name)) {}
 
-  if ((trace_ = P7_Get_Shared_Trace(name.c_str())) == nullptr) {
-    Client client("main");
-    stTrace_Conf trace_conf{};
-    trace_conf.pContext = nullptr;
-    trace_conf.qwTimestamp_Frequency = 0;
-    trace_conf.pTimestamp_Callback = nullptr;
-    trace_conf.pVerbosity_Callback = nullptr;
-    trace_conf.pConnect_Callback = nullptr;
+void Log::SendFormatted(const Level level, const std::uint16_t id,
+                        const IP7_Trace::hModule module,
+                        const CustomSourceLocation& loc,
+                        const detail::ErasedFormat& format,
+                        const std::string_view fields,
+                        const std::int64_t window, const bool redact,
+                        const bool queue) const {
+  MessageBuffer message;
+  format.Format(message);
+  detail::RenderFields(fields, message);
+  Deliver(level, id, module, loc, message, window, redact, queue);
+}
+
+void Log::SendRaised(const Level level, const Level raised,
+                      const ModuleHandle& handle,
+                      const CustomSourceLocation& loc,
+                      const detail::ErasedFormat& format,
+                      const std::string_view fields) const {
+  detail::AutoRegisterThread(trace_);
+  detail::FlushExpiredCoalesced();
+  if (detail::backtrace::Triggers(level)) [[unlikely]] {
+    detail::backtrace::Flush(trace_, level, 0, handle.module, loc,
+                             verbosity_->wrap_policy());
+  }
+  MessageBuffer message;
+  fmt::format_to(std::back_inserter(message), "{}: ", LevelName(level));
+  format.Format(message);
+  detail::RenderFields(fields, message);
+  Deliver(raised, 0, handle.module, loc, message,
+          verbosity_->CoalesceWindow(handle.id),
+          verbosity_->Redacts(static_cast<std::uint8_t>(level), handle.id),
+          raised != Level::CRITICAL && detail::async::Enabled());
+}
 
-    if ((trace_ = P7_Create_Trace(client.client(), name.c_str(),
-                                  &trace_conf)) == nullptr) {
-      throw std::runtime_error("P7_Create_Trace failed");
-    }
-    if (!trace_->Share(name.c_str())) {
-      throw std::runtime_error("trace_->Share("s + name.c_str() + ") failed."s);
-    }
-    // Intentionally increase ref counter so that the logger isn't created
-    // and destroyed constantly and to enable log support for crashes
-    //    trace_->Add_Ref();
+void Log::SendText(const Level level, const ModuleHandle& handle,
+                   const CustomSourceLocation& loc,
+                   MessageBuffer& message) const {
+  detail::AutoRegisterThread(trace_);
+  detail::FlushExpiredCoalesced();
+  if (detail::backtrace::Triggers(level)) [[unlikely]] {
+    detail::backtrace::Flush(trace_, level, 0, handle.module, loc,
+                             verbosity_->wrap_policy());
   }
+  detail::FieldBuffer context;
+  detail::AppendContext(context);
+  detail::RenderFields(std::string_view(context.data(), context.size()),
+                       message);
+  Deliver(level, 0, handle.module, loc, message,
+          verbosity_->CoalesceWindow(handle.id),
+          verbosity_->Redacts(static_cast<std::uint8_t>(level), handle.id),
+          level != Level::CRITICAL && detail::async::Enabled());
 }
 
-Log::~Log() noexcept {
-  if (trace_ != nullptr) {
-    trace_->Release();
+void Log::Deliver(const Level level, const std::uint16_t id,
+                  const IP7_Trace::hModule module,
+                  const CustomSourceLocation& loc, MessageBuffer& message,
+                  const std::int64_t window, const bool redact,
+                  const bool queue) const {
+  const WrapPolicy wrap = verbosity_->wrap_policy();
+  if (queue &&
+      detail::async::EnqueueText(trace_, level, id, module, loc, window, wrap,
+                                 redact, std::string_view(message.data(),
+                                                          message.size()))) {
+    return;
+  }
+  if (redact) {
+    detail::Redact(message);
+  }
+  if (window != 0) {
+    detail::CoalesceMessage(trace_, level, id, module, loc, message, window,
+                            wrap);
+  } else {
+    detail::TraceMessage(trace_, level, id, module, loc, message, wrap);
   }
 }
 
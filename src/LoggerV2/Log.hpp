@@ -20,26 +20,42 @@
 #ifndef SRC_LOGGERV2_LOG_HPP_
 #define SRC_LOGGERV2_LOG_HPP_
 
+#include <chrono>
 #include <cstdarg>
 #include <cstddef>
 #include <iostream>
+#include <iterator>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <utility>
-#include <vector>
 
 #include <boost/predef.h>
-#include <boost/preprocessor/facilities/overload.hpp>
-#include <boost/preprocessor/stringize.hpp>
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 
 #include "P7_Trace.h"
-#include "absl/strings/str_split.h"
 
+#include "LoggerV2/Async.hpp"
+#include "LoggerV2/Backtrace.hpp"
+#include "LoggerV2/CallSite.hpp"
+#include "LoggerV2/Capture.hpp"
+#include "LoggerV2/Channel.hpp"
+#include "LoggerV2/Coalesce.hpp"
+#include "LoggerV2/Context.hpp"
 #include "LoggerV2/CustomSourceLocation.hpp"
+#include "LoggerV2/Field.hpp"
+#include "LoggerV2/FormatString.hpp"
+#include "LoggerV2/Lazy.hpp"
+#include "LoggerV2/Message.hpp"
+#include "LoggerV2/ModuleHandle.hpp"
+#include "LoggerV2/RateLimit.hpp"
+#include "LoggerV2/Redaction.hpp"
+#include "LoggerV2/SourceName.hpp"
+#include "LoggerV2/VerbosityCache.hpp"
 #include "LoggerV2/source_location.h"
+#include "LoggerV2/ThreadRegistration.hpp"
 #include "LoggerV2/str_const.hpp"
 
 #if __has_include(<glm/gtx/io.hpp>)
@@ -49,67 +65,12 @@
 
 namespace logging {
 
+class Batch;
+
 #ifndef LOG_func_max_args
 #define LOG_func_max_args 5  // default maximum size is 5
 #endif                       /* LOG_func_max_args */
 
-enum class Level : std::uint8_t {
-  TRACE = EP7TRACE_LEVEL_TRACE,
-  DEBUG = EP7TRACE_LEVEL_DEBUG,
-  INFO = EP7TRACE_LEVEL_INFO,
-  WARNING = EP7TRACE_LEVEL_WARNING,
-  ERROR = EP7TRACE_LEVEL_ERROR,
-  CRITICAL = EP7TRACE_LEVEL_CRITICAL,
-  COUNT = EP7TRACE_LEVEL_COUNT
-};
-
-inline constexpr eP7Trace_Level convert(const Level level) {
-  switch (level) {
-    case Level::TRACE:
-      return EP7TRACE_LEVEL_TRACE;
-    case Level::DEBUG:
-      return EP7TRACE_LEVEL_DEBUG;
-    case Level::INFO:
-      return EP7TRACE_LEVEL_INFO;
-    case Level::WARNING:
-      return EP7TRACE_LEVEL_WARNING;
-    case Level::ERROR:
-      return EP7TRACE_LEVEL_ERROR;
-    case Level::CRITICAL:
-      return EP7TRACE_LEVEL_CRITICAL;
-    case Level::COUNT:
-      return EP7TRACE_LEVEL_COUNT;
-  }
-  return EP7TRACE_LEVEL_TRACE;
-}
-
-inline constexpr Level convert(const eP7Trace_Level level) {
-  switch (level) {
-    case EP7TRACE_LEVEL_TRACE:
-      return Level::TRACE;
-    case EP7TRACE_LEVEL_DEBUG:
-      return Level::DEBUG;
-    case EP7TRACE_LEVEL_INFO:
-      return Level::INFO;
-    case EP7TRACE_LEVEL_WARNING:
-      return Level::WARNING;
-    case EP7TRACE_LEVEL_ERROR:
-      return Level::ERROR;
-    case EP7TRACE_LEVEL_CRITICAL:
-      return Level::CRITICAL;
-    case EP7TRACE_LEVEL_COUNT:
-      return Level::COUNT;
-  }
-  return Level::TRACE;
-}
-
-inline constexpr std::size_t kLineWrapLength = 120;
-
-struct ModuleHandle {
-  std::string name;
-  IP7_Trace::hModule module;
-};
-
 class Log {
  public:
   Log() noexcept = default;
@@ -118,12 +79,19 @@ class Log {
   Log& operator=(Log& rhs) noexcept = default;
   Log(Log& rhs) noexcept = default;
 
-  explicit Log(const std::string name);
-  ~Log() noexcept;
+  /**
+   * @brief Logs to the named channel, see GetChannel.  Cheap enough to
+   * construct in short lived objects.
+   */
+  explicit Log(const std::string_view name);
+  explicit Log(const Channel channel) noexcept
+      : trace_(channel.trace), verbosity_(channel.verbosity) {}
+  ~Log() noexcept = default;
 
   void swap(Log& other) noexcept {
     using std::swap;
     swap(other.trace_, trace_);
+    swap(other.verbosity_, verbosity_);
   }
 
  private:
@@ -135,6 +103,10 @@ class Log {
   /**
    * @brief Registers a thread with a name for nice log output
    *
+   * Threads are registered automatically on their first message, under
+   * their pthread name, and unregistered when they exit.  This sets a
+   * different name.
+   *
    * @param name Name to associate with thread
    * @param thread_id ID of thread.  If id == 0, then the current
    * thread will be used.
@@ -142,73 +114,245 @@ class Log {
    */
   inline bool RegisterThread(const std::string& name,
                              const std::uint32_t thread_id = 0) const {
+    if (trace_ == nullptr) {
+      return false;
+    }
+    if (thread_id == 0) {
+      return detail::RegisterThread(trace_, name.c_str());
+    }
     return trace_->Register_Thread(name.c_str(), thread_id);
   }
   /**
-   * @brief Unregisters a thread
+   * @brief Unregisters a thread.  The current thread is registered again by
+   * its next message.
    *
    * @param thread_id ID of thread to unregister. If id == 0,
    * then the current thread will be used.
    * @return Returns true on success, false on failure.
    */
   inline bool UnregisterThread(const std::uint32_t thread_id = 0) const {
+    detail::FlushCoalesced();
+    if (trace_ == nullptr) {
+      return false;
+    }
+    if (thread_id == 0) {
+      return detail::UnregisterThread(trace_);
+    }
     return trace_->Unregister_Thread(thread_id);
   }
 
   /**
    * @brief Registers a module with a name and creates a module
-   * handle
+   * handle.  Registering a name again returns the same handle.
    *
    * @param name Module name
    * @return Returns a module handle if successfully created
    */
   inline std::optional<ModuleHandle> RegisterModule(
-      const std::string& name) const {
-    ModuleHandle handle{};
-    handle.name = name;
-    return (trace_->Register_Module(name.c_str(), &(handle.module))
-                ? std::optional<ModuleHandle>(handle)
-                : std::nullopt);
+      const std::string_view name) const {
+    if (trace_ == nullptr) {
+      return std::nullopt;
+    }
+    return detail::RegisterModule(trace_, verbosity_, name);
   }
 
+  /**
+   * @brief Sets the verbosity of the channel, or of a module.  Messages below
+   * the verbosity are dropped before they are formatted.
+   *
+   * Changes made from the viewer are picked up through the P7 verbosity
+   * callback.  Calling Set_Verbosity directly on get_trace() bypasses the
+   * cache, so messages below the new level would still be formatted.
+   */
   inline void SetVerbosity(const Level level) const {
-    SetVerbosity(ModuleHandle{"", nullptr}, level);
+    SetVerbosity(ModuleHandle{}, level);
   }
   inline void SetVerbosity(const ModuleHandle& handle,
                            const Level level) const {
-    trace_->Set_Verbosity(handle.module, convert(level));
+    if (trace_ != nullptr) {
+      trace_->Set_Verbosity(handle.module, convert(level));
+      verbosity_->Update(handle.module, static_cast<std::uint8_t>(level));
+    }
+  }
+
+  /**
+   * @brief Coalesces exact repeats of a message on the channel, or on a
+   * module, into one summary line.  Costs a hash of each message, and turns
+   * off the binary argument path for the channel or module.
+   *
+   * @param window Longest gap between repeats, zero turns coalescing off
+   */
+  inline void SetCoalescing(const std::chrono::nanoseconds window) const {
+    SetCoalescing(ModuleHandle{}, window);
+  }
+  inline void SetCoalescing(const ModuleHandle& handle,
+                            const std::chrono::nanoseconds window) const {
+    if (trace_ != nullptr) {
+      verbosity_->SetCoalesceWindow(handle.id, window.count());
+    }
+  }
+
+  /**
+   * @brief Sets how the channel cuts its messages into P7 records.  By
+   * default messages are split at newlines and wrapped at kLineWrapLength,
+   * which costs one P7 call per piece for long messages.  Messages sent with
+   * P7's own formatting are always one record.
+   * @code
+   * log.SetWrapPolicy({WrapMode::kWhole});
+   * log.SetWrapPolicy({WrapMode::kWrap, true, 1024});
+   * @endcode
+   */
+  inline void SetWrapPolicy(const WrapPolicy policy) const {
+    if (trace_ != nullptr) {
+      verbosity_->SetWrapPolicy(policy);
+    }
+  }
+  inline WrapPolicy GetWrapPolicy() const {
+    return verbosity_->wrap_policy();
+  }
+
+  /**
+   * @brief Masks the patterns set by SetRedactionPatterns in the messages
+   * of a level and above, on the channel or on a module.  Costs a scan of
+   * each message, and turns off the binary argument path for those levels.
+   */
+  inline void SetRedaction(const Level level) const {
+    SetRedaction(ModuleHandle{}, level);
+  }
+  inline void SetRedaction(const ModuleHandle& handle,
+                           const Level level) const {
+    if (trace_ != nullptr) {
+      verbosity_->SetRedactLevel(handle.id, static_cast<std::uint8_t>(level));
+    }
+  }
+  inline void ClearRedaction() const { ClearRedaction(ModuleHandle{}); }
+  inline void ClearRedaction(const ModuleHandle& handle) const {
+    if (trace_ != nullptr) {
+      verbosity_->SetRedactLevel(handle.id,
+                                 detail::VerbosityCache::kDisabled);
+    }
   }
+
   inline Level GetVerbosity() const {
-    return GetVerbosity(ModuleHandle{"", nullptr});
+    return GetVerbosity(ModuleHandle{});
   }
   inline Level GetVerbosity(const ModuleHandle& handle) const {
-    return convert(trace_->Get_Verbosity(handle.module));
+    return (trace_ != nullptr) ? convert(trace_->Get_Verbosity(handle.module))
+                               : Level::COUNT;
+  }
+
+  /**
+   * @brief Checks whether a message would pass the channel or module
+   * verbosity.  Costs a single relaxed load.
+   *
+   * @param level Level of the message
+   * @param handle Module the message would be sent to
+   * @return Returns true if the message would be sent
+   */
+  inline bool IsEnabled(const Level level,
+                        const ModuleHandle& handle = ModuleHandle{}) const {
+    return verbosity_->Enabled(static_cast<std::uint8_t>(level), handle.id);
+  }
+
+  /**
+   * @brief Checks whether the channel or any of its modules lets a level
+   * through.  Used by LOG_LAZY, which does not know the module.
+   */
+  inline bool IsAnyEnabled(const Level level) const {
+    return verbosity_->AnyEnabled(static_cast<std::uint8_t>(level));
+  }
+
+  /**
+   * @brief Logs how many messages a rate limited call site suppressed.  Used
+   * by LOG_EVERY_N and friends.
+   */
+  void ReportSuppressed(
+      const Level level, const ModuleHandle& handle, const std::uint64_t count,
+      const CustomSourceLocation loc = CustomSourceLocation::current()) const {
+    using namespace literals;
+    RawTrace(level, 0, handle, loc,
+             "Suppressed {} messages from this call site"_log, count);
   }
 
   template <typename... Args>
   void RawTrace(const Level level, const std::uint16_t id,
                 const ModuleHandle& handle, const CustomSourceLocation loc,
-                const std::string& format, const Args... all) const {
-    const std::string message =
-        fmt::format(format, std::forward<const Args>(all)...);
-    std::vector<std::string> parts =
-        absl::StrSplit(message, '\n', absl::SkipEmpty());
-    for (const auto& part : parts) {
-      std::vector<std::string> subparts = absl::StrSplit(
-          part, absl::ByLength(kLineWrapLength), absl::SkipEmpty());
-      for (const auto& subpart : subparts) {
-        if (!trace_->Trace_Managed(id, convert(level), handle.module,
-                                   loc.line(), loc.file_name(),
-                                   loc.function_name(), subpart.c_str())) {
-          //          std::cerr << "P7 Trace_Managed returned false!" <<
-          //          std::endl; std::cerr << "Message was:  " << subpart <<
-          //          std::endl;
+                const FormatString<Args...> format, const Args&... all) const {
+    static_assert(detail::FieldsLast<Args...>(),
+                  "Fields must follow the format arguments");
+    if (!IsCompiledIn(level)) {
+      return;
+    }
+    if (!verbosity_->Enabled(static_cast<std::uint8_t>(level), handle.id)) {
+      if constexpr (detail::backtrace::kRememberable<Args...>) {
+        if (detail::backtrace::Enabled() && trace_ != nullptr) [[unlikely]] {
+          Remember(level, id, handle, loc, format, all...);
         }
       }
+      return;
+    }
+    Send(level, id, handle, loc, format, all...);
+  }
+
+  /**
+   * @brief Logs the values returned by a callable, named by their source
+   * text.  Used by the CAPTURE macros.
+   *
+   * @param capture Returns the values as a tuple.  Invoked once, and only if
+   * the message passes the verbosity check.
+   */
+  template <detail::FixedString kNames, typename Callable>
+  void Capture(
+      const Level level, const ModuleHandle& handle,
+      const detail::CaptureNames<kNames> /*unused*/, const Callable& capture,
+      const CustomSourceLocation loc = CustomSourceLocation::current()) const {
+    using Format = detail::CaptureFormat<kNames>;
+    if (!IsCompiledIn(level) ||
+        !verbosity_->Enabled(static_cast<std::uint8_t>(level), handle.id)) {
+      return;
+    }
+    std::apply(
+        [&](const auto&... all) {
+          static_assert(Format::kCount == sizeof...(all),
+                        "Could not split the CAPTURE expressions, wrap "
+                        "template arguments in parentheses");
+          RawTrace(level, 0, handle, loc,
+                   detail::StaticFormat<Format::kText>{}, all...);
+        },
+        capture());
+  }
+
+  /**
+   * @brief Logs a message from a static call site.  Used by LOG_SITE, which
+   * passes the site instead of a source location.  The state of the site,
+   * see SetSiteState, is checked first, and the first run registers it.
+   */
+  template <typename... Args>
+  void SiteTrace(CallSite& site, const ModuleHandle& handle,
+                 const FormatString<Args...> format,
+                 const Args&... all) const {
+    const CustomSourceLocation loc{site.file, site.function, site.line,
+                                   site.column};
+    switch (site.state.load(std::memory_order_relaxed)) {
+      case SiteState::kDefault:
+        RawTrace(site.level, 0, handle, loc, format, all...);
+        break;
+      case SiteState::kEnabled:
+        if (IsCompiledIn(site.level) && trace_ != nullptr) {
+          SendEnabled(site.level, handle, loc, format, all...);
+        }
+        break;
+      case SiteState::kDisabled:
+        break;
+      default:
+        detail::RegisterSite(site);
+        SiteTrace(site, handle, format, all...);
+        break;
     }
   }
 
  public:
+
   /* If non-type template parameters of user-defined type are permitted, use
    * them so that we may pass unlimited arguments to the Log functions.
    * Otherwise, use the old preprocessor metaprogramming.
@@ -222,81 +366,74 @@ class Log {
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
   void SendTrace(const Level level, const ModuleHandle& handle,
-                 const std::string& format, const Args... all) const {
+                 const FormatString<Args...> format, const Args&... all) const {
     RawTrace(std::forward<const Level>(level), 0,
              std::forward<const ModuleHandle&>(handle),
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Trace(const std::string& format, const Args... all) const {
+  void Trace(const FormatString<Args...> format, const Args&... all) const {
     RawTrace(Level::TRACE, 0, ModuleHandle{},
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Trace(const ModuleHandle& handle, const std::string& format,
-             const Args... all) const {
+  void Trace(const ModuleHandle& handle, const FormatString<Args...> format,
+             const Args&... all) const {
     RawTrace(Level::TRACE, 0, std::forward<const ModuleHandle&>(handle),
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Debug(const std::string&& format, const Args... all) const {
+  void Debug(const FormatString<Args...> format, const Args&... all) const {
     RawTrace(Level::DEBUG, 0, ModuleHandle{},
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Debug(const ModuleHandle& handle, const std::string& format,
-             const Args... all) const {
+  void Debug(const ModuleHandle& handle, const FormatString<Args...> format,
+             const Args&... all) const {
     RawTrace(Level::DEBUG, 0, std::forward<const ModuleHandle&>(handle),
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Info(const std::string& format, const Args... all) const {
+  void Info(const FormatString<Args...> format, const Args&... all) const {
     RawTrace(Level::INFO, 0, ModuleHandle{},
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Info(const ModuleHandle& handle, const std::string& format,
-            const Args... all) const {
+  void Info(const ModuleHandle& handle, const FormatString<Args...> format,
+            const Args&... all) const {
     RawTrace(Level::INFO, 0, std::forward<const ModuleHandle&>(handle),
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
 
   template <typename... Args,
@@ -304,46 +441,42 @@ class Log {
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Warn(const std::string& format, const Args... all) const {
+  void Warn(const FormatString<Args...> format, const Args&... all) const {
     RawTrace(Level::WARNING, 0, ModuleHandle{},
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Warn(const ModuleHandle& handle, const std::string& format,
-            const Args... all) const {
+  void Warn(const ModuleHandle& handle, const FormatString<Args...> format,
+            const Args&... all) const {
     RawTrace(Level::WARNING, 0, std::forward<const ModuleHandle&>(handle),
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Warning(const std::string& format, const Args... all) const {
+  void Warning(const FormatString<Args...> format, const Args&... all) const {
     RawTrace(Level::WARNING, 0, ModuleHandle{},
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Warning(const ModuleHandle& handle, const std::string& format,
-               const Args... all) const {
+  void Warning(const ModuleHandle& handle, const FormatString<Args...> format,
+               const Args&... all) const {
     RawTrace(Level::WARNING, 0, std::forward<const ModuleHandle&>(handle),
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
 
   template <typename... Args,
@@ -351,92 +484,84 @@ class Log {
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Error(const std::string& format, const Args... all) const {
+  void Error(const FormatString<Args...> format, const Args&... all) const {
     RawTrace(Level::ERROR, 0, ModuleHandle{},
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Error(const ModuleHandle& handle, const std::string& format,
-             const Args... all) const {
+  void Error(const ModuleHandle& handle, const FormatString<Args...> format,
+             const Args&... all) const {
     RawTrace(Level::ERROR, 0, std::forward<const ModuleHandle&>(handle),
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Critical(const std::string& format, const Args... all) const {
+  void Critical(const FormatString<Args...> format, const Args&... all) const {
     RawTrace(Level::CRITICAL, 0, ModuleHandle{},
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Critical(const ModuleHandle& handle, const std::string& format,
-                const Args... all) const {
+  void Critical(const ModuleHandle& handle, const FormatString<Args...> format,
+                const Args&... all) const {
     RawTrace(Level::CRITICAL, 0, std::forward<const ModuleHandle&>(handle),
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Crit(const std::string& format, const Args... all) const {
+  void Crit(const FormatString<Args...> format, const Args&... all) const {
     RawTrace(Level::CRITICAL, 0, ModuleHandle{},
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Crit(const ModuleHandle& handle, const std::string& format,
-            const Args... all) const {
+  void Crit(const ModuleHandle& handle, const FormatString<Args...> format,
+            const Args&... all) const {
     RawTrace(Level::CRITICAL, 0, std::forward<const ModuleHandle&>(handle),
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Count(const std::string& format, const Args... all) const {
+  void Count(const FormatString<Args...> format, const Args&... all) const {
     RawTrace(Level::COUNT, 0, ModuleHandle{},
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
   template <typename... Args,
             str_const file_name = str_const(sl::current().file_name()),
             str_const function_name = str_const(sl::current().function_name()),
             std::uint_least32_t line = sl::current().line(),
             std::uint_least32_t column = sl::current().column()>
-  void Count(const ModuleHandle& handle, const std::string& format,
-             const Args... all) const {
+  void Count(const ModuleHandle& handle, const FormatString<Args...> format,
+             const Args&... all) const {
     RawTrace(Level::COUNT, 0, std::forward<const ModuleHandle&>(handle),
              CustomSourceLocation{file_name, function_name, line, column},
-             std::forward<const std::string&>(format),
-             std::forward<const Args>(all)...);
+             format, all...);
   }
 #else /* BOOST_COMP_GNUC <= BOOST_VERSION_NUMBER(9, 0, 0) */
 #include <boost/preprocessor/array/elem.hpp>
@@ -488,108 +613,183 @@ class Log {
 
 #endif /* BOOST_COMP_GNUC >= BOOST_VERSION_NUMBER(9, 0, 0) */
  private:
+  friend class Batch;
+
+  /**
+   * @brief Sends a message that passed the verbosity check.  Kept out of
+   * line, so that a call site only holds the check and the call.  Only the
+   * steps that need the argument types are left here, formatting is done by
+   * SendFormatted.
+   */
+  template <typename... Args>
+  [[gnu::noinline]] void Send(const Level level, const std::uint16_t id,
+                              const ModuleHandle& handle,
+                              const CustomSourceLocation& loc,
+                              const FormatString<Args...>& format,
+                              const Args&... all) const {
+    detail::AutoRegisterThread(trace_);
+    detail::FlushExpiredCoalesced();
+    if (detail::backtrace::Triggers(level)) [[unlikely]] {
+      detail::backtrace::Flush(trace_, level, id, handle.module, loc,
+                               verbosity_->wrap_policy());
+    }
+    const std::int64_t window = verbosity_->CoalesceWindow(handle.id);
+    const bool redact =
+        verbosity_->Redacts(static_cast<std::uint8_t>(level), handle.id);
+    if constexpr (detail::kNativeArgs<Args...>) {
+      if (format.native() != nullptr && window == 0 && !redact &&
+          detail::context.size == 0) {
+        /* P7 sends the translated format once, then only the arguments. */
+        const char* const file = detail::TrimFileName(loc.file_name());
+        trace_->Trace(id, convert(level), handle.module, loc.line(), file,
+                      loc.function_name(), format.native(), all...);
+        detail::ObserveTrace(level, file, format.native());
+        return;
+      }
+    }
+    detail::FieldBuffer fields;
+    detail::AppendContext(fields);
+    (detail::EncodeField(fields, all), ...);
+    const std::string_view encoded(fields.data(), fields.size());
+    const bool queue = level != Level::CRITICAL && detail::async::Enabled();
+    if (queue &&
+        Enqueue(std::make_index_sequence<sizeof...(Args) -
+                                         detail::kFieldCount<Args...>>{},
+                level, id, handle.module, loc, window, redact, format.text(),
+                encoded, std::forward_as_tuple(all...))) {
+      return;
+    }
+    const std::tuple<const Args&...> values(all...);
+    SendFormatted(level, id, handle.module, loc,
+                  format.Erase(fmt::make_format_args(all...), values), encoded,
+                  window, redact, queue);
+  }
+
+  /**
+   * @brief Sends the message of an enabled call site.  P7 drops messages
+   * below the channel or module verbosity, so a message under it is sent at
+   * that verbosity instead, with its own level written before the text.
+   */
+  template <typename... Args>
+  [[gnu::noinline]] void SendEnabled(const Level level,
+                                     const ModuleHandle& handle,
+                                     const CustomSourceLocation& loc,
+                                     const FormatString<Args...>& format,
+                                     const Args&... all) const {
+    const Level floor = GetVerbosity(handle);
+    if (level >= floor) {
+      Send(level, 0, handle, loc, format, all...);
+      return;
+    }
+    detail::FieldBuffer fields;
+    detail::AppendContext(fields);
+    (detail::EncodeField(fields, all), ...);
+    const std::tuple<const Args&...> values(all...);
+    SendRaised(level, floor, handle, loc,
+               format.Erase(fmt::make_format_args(all...), values),
+               std::string_view(fields.data(), fields.size()));
+  }
+
+  /**
+   * @brief Formats a message of an enabled site after its level name and
+   * sends it at the raised level.  See SendEnabled.
+   */
+  void SendRaised(const Level level, const Level raised,
+                  const ModuleHandle& handle, const CustomSourceLocation& loc,
+                  const detail::ErasedFormat& format,
+                  const std::string_view fields) const;
+
+  /**
+   * @brief Formats a message and sends it, or queues the text if queue is
+   * set.  Not a template, so the formatting code is shared by every call
+   * site.
+   */
+  [[gnu::noinline]] void SendFormatted(const Level level,
+                                       const std::uint16_t id,
+                                       const IP7_Trace::hModule module,
+                                       const CustomSourceLocation& loc,
+                                       const detail::ErasedFormat& format,
+                                       const std::string_view fields,
+                                       const std::int64_t window,
+                                       const bool redact,
+                                       const bool queue) const;
+
+  /**
+   * @brief Sends text the caller formatted, taking the same steps as Send.
+   * The text is queued in one slot, which owns a copy of it if it does not
+   * fit in the slot.  Used by Batch.
+   */
+  void SendText(const Level level, const ModuleHandle& handle,
+                const CustomSourceLocation& loc, MessageBuffer& message) const;
+
+  /* Queues a rendered message if queue is set, or redacts, coalesces and
+   * sends it. */
+  void Deliver(const Level level, const std::uint16_t id,
+               const IP7_Trace::hModule module, const CustomSourceLocation& loc,
+               MessageBuffer& message, const std::int64_t window,
+               const bool redact, const bool queue) const;
+
+  /* Queues the format arguments, the leading kArgs arguments of a call,
+   * with the encoded fields.  Returns false if one of them must be
+   * formatted by the caller, see kCopyableArg. */
+  template <std::size_t... kArgs, typename... Args>
+  bool Enqueue(std::index_sequence<kArgs...> /*unused*/, const Level level,
+               const std::uint16_t id, const IP7_Trace::hModule module,
+               const CustomSourceLocation& loc, const std::int64_t window,
+               const bool redact, const std::string_view format,
+               const std::string_view fields,
+               const std::tuple<const Args&...>& all) const {
+    if constexpr ((detail::async::kQueueable<detail::Evaluated<
+                       std::tuple_element_t<kArgs, std::tuple<Args...>>>> &&
+                   ...)) {
+      return detail::async::Enqueue(trace_, level, id, module, loc, window,
+                                    verbosity_->wrap_policy(), redact, format,
+                                    fields,
+                                    detail::Evaluate(std::get<kArgs>(all))...);
+    } else {
+      return false;
+    }
+  }
+
+  /**
+   * @brief Copies a suppressed message into the backtrace ring.  Kept out of
+   * line, so that it does not weigh on the inlined verbosity check.
+   */
+  template <typename... Args>
+  [[gnu::noinline, gnu::cold]] void Remember(
+      const Level level, const std::uint16_t id, const ModuleHandle& handle,
+      const CustomSourceLocation loc, const FormatString<Args...> format,
+      const Args&... all) const {
+    detail::FieldBuffer fields;
+    detail::AppendContext(fields);
+    (detail::EncodeField(fields, all), ...);
+    RememberArgs(std::make_index_sequence<sizeof...(Args) -
+                                          detail::kFieldCount<Args...>>{},
+                 level, id, handle.module, loc,
+                 verbosity_->Redacts(static_cast<std::uint8_t>(level),
+                                     handle.id),
+                 format.text(), std::string_view(fields.data(), fields.size()),
+                 std::forward_as_tuple(all...));
+  }
+
+  /* Remembers the format arguments, the leading kArgs arguments of a call,
+   * with the encoded fields. */
+  template <std::size_t... kArgs, typename... Args>
+  void RememberArgs(std::index_sequence<kArgs...> /*unused*/,
+                    const Level level, const std::uint16_t id,
+                    const IP7_Trace::hModule module,
+                    const CustomSourceLocation& loc, const bool redact,
+                    const std::string_view format,
+                    const std::string_view fields,
+                    const std::tuple<const Args&...>& all) const {
+    detail::backtrace::Remember(trace_, level, id, module, loc, redact, format,
+                                fields, std::get<kArgs>(all)...);
+  }
+
   IP7_Trace* trace_ = nullptr;
+  detail::VerbosityCache* verbosity_ = detail::VerbosityCache::Disabled();
 };
 
-/* Define the CAPTURE macro for up to 10 arguments. */
-/**
- * @brief
- *
- */
-#define CAPTURE(...) \
-  BOOST_PP_OVERLOAD(__LOG_INTERNAL_CAPTURE_, __VA_ARGS__)(__VA_ARGS__)
-
-// clang-format off
-#define __LOG_INTERNAL_CAPTURE_1(elem1) \
-Trace(BOOST_PP_STRINGIZE(elem1) " = {} ", elem1)
-#define __LOG_INTERNAL_CAPTURE_2(elem1, elem2) \
-Trace(                                       \
-    BOOST_PP_STRINGIZE(elem1) " = {} | "     \
-    BOOST_PP_STRINGIZE(elem2) " = {}",       \
-elem1, elem2)
-#define __LOG_INTERNAL_CAPTURE_3(elem1, elem2, elem3) \
-Trace(                                              \
-    BOOST_PP_STRINGIZE(elem1) " = {} | "            \
-    BOOST_PP_STRINGIZE(elem2) " = {} | "            \
-    BOOST_PP_STRINGIZE(elem3) " = {}",              \
-elem1, elem2, elem3)
-#define __LOG_INTERNAL_CAPTURE_4(elem1, elem2, elem3, elem4) \
-Trace(                                                     \
-    BOOST_PP_STRINGIZE(elem1) " = {} | "                   \
-    BOOST_PP_STRINGIZE(elem2) " = {} | "                   \
-    BOOST_PP_STRINGIZE(elem3) " = {} | "                   \
-    BOOST_PP_STRINGIZE(elem4) " = {}",                     \
-elem1, elem2, elem3, elem4)
-#define __LOG_INTERNAL_CAPTURE_5(elem1, elem2, elem3, elem4, elem5) \
-Trace(                                                            \
-    BOOST_PP_STRINGIZE(elem1) " = {} | "                          \
-    BOOST_PP_STRINGIZE(elem2) " = {} | "                          \
-    BOOST_PP_STRINGIZE(elem3) " = {} | "                          \
-    BOOST_PP_STRINGIZE(elem4) " = {} | "                          \
-    BOOST_PP_STRINGIZE(elem5) " = {}",                            \
-elem1, elem2, elem3, elem4, elem5)
-#define __LOG_INTERNAL_CAPTURE_6(elem1, elem2, elem3, elem4, elem5, elem6) \
-Trace(                                                                   \
-    BOOST_PP_STRINGIZE(elem1) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem2) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem3) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem4) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem5) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem6) " = {}",                                   \
-elem1, elem2, elem3, elem4, elem5, elem6)
-#define __LOG_INTERNAL_CAPTURE_7(elem1, elem2, elem3, elem4, elem5, elem6, \
-                               elem7)                                    \
-Trace(                                                                   \
-    BOOST_PP_STRINGIZE(elem1) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem2) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem3) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem4) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem5) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem6) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem7) " = {}",                                   \
-elem1, elem2, elem3, elem4, elem5, elem6, elem7)
-#define __LOG_INTERNAL_CAPTURE_8(elem1, elem2, elem3, elem4, elem5, elem6, \
-                               elem7, elem8)                             \
-Trace(                                                                   \
-    BOOST_PP_STRINGIZE(elem1) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem2) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem3) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem4) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem5) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem6) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem7) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem8) " = {}",                                   \
-elem1, elem2, elem3, elem4, elem5, elem6, elem7, elem8)
-#define __LOG_INTERNAL_CAPTURE_9(elem1, elem2, elem3, elem4, elem5, elem6, \
-                               elem7, elem8, elem9)                      \
-Trace(                                                                   \
-    BOOST_PP_STRINGIZE(elem1) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem2) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem3) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem4) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem5) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem6) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem7) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem8) " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem9) " = {}",                                   \
-elem1, elem2, elem3, elem4, elem5, elem6, elem7, elem8, elem9)
-#define __LOG_INTERNAL_CAPTURE_10(elem1, elem2, elem3, elem4, elem5, elem6, \
-                                elem7, elem8, elem9, elem10)              \
-Trace(                                                                    \
-    BOOST_PP_STRINGIZE(elem1)  " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem2)  " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem3)  " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem4)  " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem5)  " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem6)  " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem7)  " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem8)  " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem9)  " = {} | "                                 \
-    BOOST_PP_STRINGIZE(elem10) " = {}",                                   \
-elem1, elem2, elem3, elem4, elem5, elem6, elem7, elem8, elem9, elem10)
-
-// clang-format on
-
 inline void swap(Log& a, Log& b) noexcept { a.swap(b); }
 
 } /* namespace logging */
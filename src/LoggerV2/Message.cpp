@@ -0,0 +1,66 @@
+/******************************************************************************
+ * Message.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/Message.hpp"
+
+#include <algorithm>
+#include <string_view>
+
+#include "P7_Trace.h"
+
+#include "LoggerV2/LineSplitter.hpp"
+#include "LoggerV2/SourceName.hpp"
+
+namespace logging::detail {
+
+void TraceMessage(IP7_Trace* trace, const Level level, const std::uint16_t id,
+                  const IP7_Trace::hModule module,
+                  const CustomSourceLocation& loc, MessageBuffer& message,
+                  const WrapPolicy wrap) {
+  message.push_back('\0');
+  const std::size_t length =
+      wrap.mode == WrapMode::kWrap
+          ? std::clamp<std::size_t>(wrap.length, 1, kMaxRecordLength)
+          : kMaxRecordLength;
+  LineSplitter splitter(std::string_view(message.data(), message.size() - 1),
+                        length, wrap.mode != WrapMode::kWhole);
+  const char* const file = TrimFileName(loc.file_name());
+  bool first = true;
+  for (std::string_view piece; splitter.Next(piece); first = false) {
+    const bool bare = wrap.bare_continuations && !first;
+    /* P7 takes null terminated strings, so terminate the piece in place. */
+    char* const piece_end =
+        message.data() + (piece.data() - message.data()) + piece.size();
+    const char saved = *piece_end;
+    *piece_end = '\0';
+    if (!trace->Trace_Managed(id, convert(level), module,
+                              bare ? 0 : loc.line(),
+                              bare ? "" : file,
+                              bare ? "" : loc.function_name(), piece.data())) {
+      //          std::cerr << "P7 Trace_Managed returned false!" <<
+      //          std::endl; std::cerr << "Message was:  " << line <<
+      //          std::endl;
+    }
+    ObserveTrace(level, bare ? "" : file, piece);
+    *piece_end = saved;
+  }
+}
+
+} /* namespace logging::detail */
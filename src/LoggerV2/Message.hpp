@@ -0,0 +1,191 @@
+/******************************************************************************
+ * Message.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_MESSAGE_HPP_
+#define SRC_LOGGERV2_MESSAGE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "P7_Trace.h"
+
+#include "LoggerV2/CustomSourceLocation.hpp"
+
+namespace logging {
+
+enum class Level : std::uint8_t {
+  TRACE = EP7TRACE_LEVEL_TRACE,
+  DEBUG = EP7TRACE_LEVEL_DEBUG,
+  INFO = EP7TRACE_LEVEL_INFO,
+  WARNING = EP7TRACE_LEVEL_WARNING,
+  ERROR = EP7TRACE_LEVEL_ERROR,
+  CRITICAL = EP7TRACE_LEVEL_CRITICAL,
+  COUNT = EP7TRACE_LEVEL_COUNT
+};
+
+inline constexpr eP7Trace_Level convert(const Level level) {
+  switch (level) {
+    case Level::TRACE:
+      return EP7TRACE_LEVEL_TRACE;
+    case Level::DEBUG:
+      return EP7TRACE_LEVEL_DEBUG;
+    case Level::INFO:
+      return EP7TRACE_LEVEL_INFO;
+    case Level::WARNING:
+      return EP7TRACE_LEVEL_WARNING;
+    case Level::ERROR:
+      return EP7TRACE_LEVEL_ERROR;
+    case Level::CRITICAL:
+      return EP7TRACE_LEVEL_CRITICAL;
+    case Level::COUNT:
+      return EP7TRACE_LEVEL_COUNT;
+  }
+  return EP7TRACE_LEVEL_TRACE;
+}
+
+inline constexpr Level convert(const eP7Trace_Level level) {
+  switch (level) {
+    case EP7TRACE_LEVEL_TRACE:
+      return Level::TRACE;
+    case EP7TRACE_LEVEL_DEBUG:
+      return Level::DEBUG;
+    case EP7TRACE_LEVEL_INFO:
+      return Level::INFO;
+    case EP7TRACE_LEVEL_WARNING:
+      return Level::WARNING;
+    case EP7TRACE_LEVEL_ERROR:
+      return Level::ERROR;
+    case EP7TRACE_LEVEL_CRITICAL:
+      return Level::CRITICAL;
+    case EP7TRACE_LEVEL_COUNT:
+      return Level::COUNT;
+  }
+  return Level::TRACE;
+}
+
+/** @brief Returns the name of a level, e.g. "DEBUG" */
+inline constexpr const char* LevelName(const Level level) noexcept {
+  switch (level) {
+    case Level::TRACE:
+      return "TRACE";
+    case Level::DEBUG:
+      return "DEBUG";
+    case Level::INFO:
+      return "INFO";
+    case Level::WARNING:
+      return "WARNING";
+    case Level::ERROR:
+      return "ERROR";
+    case Level::CRITICAL:
+      return "CRITICAL";
+    case Level::COUNT:
+      break;
+  }
+  return "UNKNOWN";
+}
+
+#ifndef MIN_LOG_LEVEL
+#define MIN_LOG_LEVEL 0  // TRACE, every level is compiled in
+#endif                   /* MIN_LOG_LEVEL */
+
+/* Messages below this level are removed at compile time.  The value must be
+ * the same in every translation unit, as the Log templates depend on it. */
+inline constexpr Level kMinLogLevel = static_cast<Level>(MIN_LOG_LEVEL);
+
+inline constexpr bool IsCompiledIn(const Level level) {
+  return static_cast<std::uint8_t>(level) >=
+         static_cast<std::uint8_t>(kMinLogLevel);
+}
+
+inline constexpr std::size_t kLineWrapLength = 120;
+/** @brief Longest piece sent to P7 in one record, whatever the wrap policy */
+inline constexpr std::size_t kMaxRecordLength = 16384;
+
+/** @brief How a channel cuts its messages into P7 records */
+enum class WrapMode : std::uint8_t {
+  /** @brief Split at newlines and wrap lines at the wrap length */
+  kWrap,
+  /** @brief Split at newlines, but do not wrap lines */
+  kNewlines,
+  /** @brief Send each message whole, newlines included */
+  kWhole,
+};
+
+/**
+ * @brief Wrap policy of a channel, see Log::SetWrapPolicy.  Pieces never
+ * exceed kMaxRecordLength, so in kNewlines and kWhole modes a very long
+ * message is still cut at that length.
+ */
+struct WrapPolicy {
+  WrapMode mode = WrapMode::kWrap;
+  /** @brief Omit the file, line and function from all but the first piece */
+  bool bare_continuations = false;
+  /** @brief Wrap length of kWrap mode, clamped to [1, kMaxRecordLength] */
+  std::uint32_t length = kLineWrapLength;
+};
+
+/* Messages up to this size are formatted on the stack without allocating. */
+inline constexpr std::size_t kMessageBufferSize = 512;
+using MessageBuffer = fmt::basic_memory_buffer<char, kMessageBufferSize>;
+
+namespace detail {
+
+/**
+ * @brief Cuts a formatted message into pieces as the wrap policy says,
+ * sending every piece to P7.  See LineSplitter.
+ *
+ * The pieces are terminated in place inside the buffer, so no copies of
+ * the message are made.
+ *
+ * @param message Formatted message.  Its contents are restored before
+ * returning, but a trailing null terminator is appended.
+ */
+void TraceMessage(IP7_Trace* trace, const Level level, const std::uint16_t id,
+                  const IP7_Trace::hModule module,
+                  const CustomSourceLocation& loc, MessageBuffer& message,
+                  const WrapPolicy wrap = WrapPolicy{});
+
+/**
+ * @brief Receives each record handed to P7, e.g. so that tests can check
+ * what was sent.  The text of a record with native arguments is its format.
+ */
+using TraceObserver = void (*)(const Level level, const char* file,
+                               const std::string_view text);
+/** @brief Observer of the records handed to P7, nullptr for none */
+inline std::atomic<TraceObserver> trace_observer{nullptr};
+
+/** @brief Passes a record handed to P7 to the trace observer, if any */
+inline void ObserveTrace(const Level level, const char* file,
+                         const std::string_view text) {
+  if (const TraceObserver observer =
+          trace_observer.load(std::memory_order_relaxed);
+      observer != nullptr) [[unlikely]] {
+    observer(level, file, text);
+  }
+}
+
+} /* namespace detail */
+
+} /* namespace logging */
+
+#endif /* SRC_LOGGERV2_MESSAGE_HPP_ */
@@ -0,0 +1,148 @@
+/******************************************************************************
+ * ModuleHandle.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/ModuleHandle.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "P7_Trace.h"
+
+namespace logging {
+
+namespace {
+
+/* Number of slots of the table of interned modules, a power of two.  At
+ * most kMaxInterned are used, so that probes stay short and always end at a
+ * free slot.  Modules registered once the table is full are kept in the
+ * overflow map, and get handles without a name. */
+constexpr std::size_t kTableSize = 4096;
+constexpr std::size_t kMaxInterned = kTableSize / 4 * 3;
+static_assert(kTableSize <= ModuleHandle::kNoName);
+
+struct Entry {
+  IP7_Trace* trace;
+  std::string name;
+  ModuleHandle handle;
+};
+
+/* Open addressing with linear probing.  Entries are published with a
+ * release store and never removed, so lookups only need acquire loads.
+ * Constant initialized and never destroyed, as modules may be used at exit.
+ */
+std::array<std::atomic<const Entry*>, kTableSize> table{};
+
+std::mutex& TableMutex() {
+  static auto* mutex = new std::mutex;
+  return *mutex;
+}
+
+/* Entries in the table, guarded by TableMutex */
+std::size_t interned = 0;
+
+/* Modules that did not fit in the table, guarded by TableMutex */
+using OverflowKey = std::pair<IP7_Trace*, std::string>;
+std::map<OverflowKey, ModuleHandle>& Overflow() {
+  static auto* overflow = new std::map<OverflowKey, ModuleHandle>;
+  return *overflow;
+}
+
+std::size_t Hash(IP7_Trace* trace, const std::string_view name) noexcept {
+  return std::hash<std::string_view>{}(name) ^
+         (reinterpret_cast<std::uintptr_t>(trace) >> 4);
+}
+
+/* Returns the entry of the module, or the index of the free slot where it
+ * would go.  The table always has a free slot, see kMaxInterned. */
+const Entry* Find(IP7_Trace* trace, const std::string_view name,
+                  std::size_t& free) noexcept {
+  const std::size_t hash = Hash(trace, name);
+  for (std::size_t index = hash & (kTableSize - 1);;
+       index = (index + 1) & (kTableSize - 1)) {
+    const Entry* entry = table[index].load(std::memory_order_acquire);
+    if (entry == nullptr) {
+      free = index;
+      return nullptr;
+    }
+    if (entry->trace == trace && entry->name == name) {
+      return entry;
+    }
+  }
+}
+
+} /* namespace */
+
+std::string_view ModuleHandle::name() const noexcept {
+  if (name_id == kNoName) {
+    return {};
+  }
+  return table[name_id].load(std::memory_order_acquire)->name;
+}
+
+namespace detail {
+
+std::optional<ModuleHandle> RegisterModule(IP7_Trace* trace,
+                                           VerbosityCache* verbosity,
+                                           const std::string_view name) {
+  std::size_t free = 0;
+  if (const Entry* entry = Find(trace, name, free)) {
+    return entry->handle;
+  }
+
+  std::lock_guard<std::mutex> lock(TableMutex());
+  if (const Entry* entry = Find(trace, name, free)) {
+    return entry->handle;
+  }
+  OverflowKey key(trace, name);
+  const bool full = interned == kMaxInterned;
+  if (full) {
+    const auto found = Overflow().find(key);
+    if (found != Overflow().end()) {
+      return found->second;
+    }
+  }
+  ModuleHandle handle{};
+  if (!trace->Register_Module(key.second.c_str(), &handle.module)) {
+    return std::nullopt;
+  }
+  handle.id = verbosity->Register(
+      handle.module,
+      static_cast<std::uint8_t>(trace->Get_Verbosity(handle.module)));
+  if (full) {
+    Overflow().emplace(std::move(key), handle);
+  } else {
+    handle.name_id = static_cast<std::uint16_t>(free);
+    table[free].store(new Entry{trace, std::move(key.second), handle},
+                      std::memory_order_release);
+    ++interned;
+  }
+  return handle;
+}
+
+} /* namespace detail */
+
+} /* namespace logging */
@@ -0,0 +1,71 @@
+/******************************************************************************
+ * ModuleHandle.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_MODULEHANDLE_HPP_
+#define SRC_LOGGERV2_MODULEHANDLE_HPP_
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+
+#include "P7_Trace.h"
+
+#include "LoggerV2/VerbosityCache.hpp"
+
+namespace logging {
+
+/**
+ * @brief A module of a trace channel, created by Log::RegisterModule.  The
+ * default handle stands for the channel itself.
+ *
+ * Module names are interned when the module is registered, so handles are
+ * small and trivially copyable.
+ */
+struct ModuleHandle {
+  static inline constexpr std::uint16_t kNoName = UINT16_MAX;
+
+  /** @brief Returns the name the module was registered with */
+  std::string_view name() const noexcept;
+
+  IP7_Trace::hModule module = nullptr;
+  /** @brief Slot of the module in its channel's verbosity cache */
+  std::uint16_t id = detail::VerbosityCache::kChannelSlot;
+  /** @brief Index of the module in the table of interned modules */
+  std::uint16_t name_id = kNoName;
+};
+static_assert(std::is_trivially_copyable_v<ModuleHandle>);
+static_assert(sizeof(ModuleHandle) <= 16);
+
+namespace detail {
+
+/**
+ * @brief Registers a module with a channel, or returns the handle it was
+ * registered with before.  Looking up a registered module takes no locks,
+ * unless it was registered after the first 3072 modules.
+ */
+std::optional<ModuleHandle> RegisterModule(IP7_Trace* trace,
+                                           VerbosityCache* verbosity,
+                                           const std::string_view name);
+
+} /* namespace detail */
+
+} /* namespace logging */
+
+#endif /* SRC_LOGGERV2_MODULEHANDLE_HPP_ */
@@ -0,0 +1,260 @@
+/******************************************************************************
+ * RateLimit.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_RATELIMIT_HPP_
+#define SRC_LOGGERV2_RATELIMIT_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/variadic/elem.hpp>
+
+#include "LoggerV2/Message.hpp"
+#include "LoggerV2/ModuleHandle.hpp"
+
+namespace logging::detail {
+
+/**
+ * @brief State of one rate limited call site
+ *
+ * Each LOG_EVERY_N, LOG_FIRST_N, LOG_EVERY_T and LOG_SAMPLED call site owns
+ * a static RateLimiter.  Deciding costs one or two relaxed atomic operations.
+ */
+class RateLimiter {
+ public:
+  struct Decision {
+    bool pass;
+    /** @brief Messages suppressed since the last report, to report now */
+    std::uint64_t suppressed;
+  };
+
+  /**
+   * @brief Logs the 1st, (n+1)th, (2n+1)th... calls.  The suppressed calls
+   * are not reported, as there are always n - 1 of them.
+   */
+  Decision EveryN(const std::uint64_t n) noexcept {
+    const std::uint64_t count = count_.fetch_add(1, std::memory_order_relaxed);
+    return Decision{n <= 1 || count % n == 0, 0};
+  }
+
+  /**
+   * @brief Logs the first n calls.  Later calls are reported when the number
+   * suppressed reaches a power of two.
+   */
+  Decision FirstN(const std::uint64_t n) noexcept {
+    const std::uint64_t count = count_.fetch_add(1, std::memory_order_relaxed);
+    if (count < n) {
+      return Decision{true, 0};
+    }
+    const std::uint64_t suppressed = count - n + 1;
+    if ((suppressed & (suppressed - 1)) != 0) {
+      return Decision{false, 0};
+    }
+    return Decision{false, suppressed - suppressed / 2};
+  }
+
+  /**
+   * @brief Logs at most once per period.  The calls suppressed since the
+   * last logged one are reported by the next logged one.
+   */
+  Decision EveryT(const std::chrono::nanoseconds period) noexcept {
+    const std::int64_t now =
+        std::chrono::steady_clock::now().time_since_epoch().count();
+    std::int64_t next = next_.load(std::memory_order_relaxed);
+    if (now < next || !next_.compare_exchange_strong(
+                          next, now + period.count(),
+                          std::memory_order_relaxed)) {
+      count_.fetch_add(1, std::memory_order_relaxed);
+      return Decision{false, 0};
+    }
+    return Decision{true, count_.exchange(0, std::memory_order_relaxed)};
+  }
+
+  /**
+   * @brief Logs each call with the given probability.  The calls suppressed
+   * since the last logged one are reported by the next logged one.
+   */
+  Decision Sampled(const double probability) noexcept {
+    if (NextUniform() >= probability) {
+      count_.fetch_add(1, std::memory_order_relaxed);
+      return Decision{false, 0};
+    }
+    return Decision{true, count_.exchange(0, std::memory_order_relaxed)};
+  }
+
+ private:
+  /* Returns a number in [0, 1) from a per-thread xorshift64* generator. */
+  static double NextUniform() noexcept {
+    thread_local std::uint64_t state =
+        (static_cast<std::uint64_t>(
+             std::chrono::steady_clock::now().time_since_epoch().count()) ^
+         reinterpret_cast<std::uintptr_t>(&state)) |
+        1;
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return static_cast<double>((state * 0x2545F4914F6CDD1DULL) >> 11) *
+           0x1.0p-53;
+  }
+
+  std::atomic<std::uint64_t> count_{0};
+  std::atomic<std::int64_t> next_{0};
+};
+
+/* Stands in for the arguments missing from short Log calls */
+struct NoArgument {};
+inline constexpr NoArgument kNoArgument{};
+
+/**
+ * @brief Returns the module a Log call is sent to.  Takes getters of the
+ * leading arguments of the call, and only invokes the getter of the module
+ * handle, so that the other arguments are not evaluated.
+ */
+template <typename Getter, typename... Rest>
+ModuleHandle CallModule(const Getter& getter, const Rest&... rest) {
+  using T = std::decay_t<std::invoke_result_t<const Getter&>>;
+  if constexpr (std::is_same_v<T, ModuleHandle>) {
+    return getter();
+  } else if constexpr (sizeof...(Rest) != 0 &&
+                       (std::is_same_v<T, Level> || std::is_integral_v<T>)) {
+    /* A level or a message id comes before the module */
+    return CallModule(rest...);
+  } else {
+    return ModuleHandle{};
+  }
+}
+
+} /* namespace logging::detail */
+
+/* Level of the messages of a Log function, used to report suppressed
+ * messages at the same level.  SendTrace takes it as its first argument, so
+ * it is evaluated once, see LOG_INTERNAL_CALL_SendTrace.
+ */
+#define LOG_INTERNAL_LEVEL_SendTrace(...) BOOST_PP_VARIADIC_ELEM(0, __VA_ARGS__)
+#define LOG_INTERNAL_LEVEL_Trace(...) ::logging::Level::TRACE
+#define LOG_INTERNAL_LEVEL_Debug(...) ::logging::Level::DEBUG
+#define LOG_INTERNAL_LEVEL_Info(...) ::logging::Level::INFO
+#define LOG_INTERNAL_LEVEL_Warn(...) ::logging::Level::WARNING
+#define LOG_INTERNAL_LEVEL_Warning(...) ::logging::Level::WARNING
+#define LOG_INTERNAL_LEVEL_Error(...) ::logging::Level::ERROR
+#define LOG_INTERNAL_LEVEL_Critical(...) ::logging::Level::CRITICAL
+#define LOG_INTERNAL_LEVEL_Crit(...) ::logging::Level::CRITICAL
+#define LOG_INTERNAL_LEVEL_Count(...) ::logging::Level::COUNT
+
+// clang-format off
+/* Getter of the nth argument of a Log call, see CallModule */
+#define LOG_INTERNAL_ARG(n, ...)                                             \
+  [&]() -> decltype(auto) {                                                  \
+    return (BOOST_PP_VARIADIC_ELEM(n, __VA_ARGS__,                           \
+                                   ::logging::detail::kNoArgument,           \
+                                   ::logging::detail::kNoArgument));         \
+  }
+
+/* Module of the messages of a Log call, used to report suppressed messages
+ * to the same module.  The module follows the level and the message id, so
+ * only the first two arguments, three for SendTrace, are inspected.
+ */
+#define LOG_INTERNAL_MODULE_SendTrace(...)                                   \
+  ::logging::detail::CallModule(LOG_INTERNAL_ARG(0, __VA_ARGS__),            \
+                                LOG_INTERNAL_ARG(1, __VA_ARGS__),            \
+                                LOG_INTERNAL_ARG(2, __VA_ARGS__))
+#define LOG_INTERNAL_MODULE(...)                                             \
+  ::logging::detail::CallModule(LOG_INTERNAL_ARG(0, __VA_ARGS__),            \
+                                LOG_INTERNAL_ARG(1, __VA_ARGS__))
+#define LOG_INTERNAL_MODULE_Trace LOG_INTERNAL_MODULE
+#define LOG_INTERNAL_MODULE_Debug LOG_INTERNAL_MODULE
+#define LOG_INTERNAL_MODULE_Info LOG_INTERNAL_MODULE
+#define LOG_INTERNAL_MODULE_Warn LOG_INTERNAL_MODULE
+#define LOG_INTERNAL_MODULE_Warning LOG_INTERNAL_MODULE
+#define LOG_INTERNAL_MODULE_Error LOG_INTERNAL_MODULE
+#define LOG_INTERNAL_MODULE_Critical LOG_INTERNAL_MODULE
+#define LOG_INTERNAL_MODULE_Crit LOG_INTERNAL_MODULE
+#define LOG_INTERNAL_MODULE_Count LOG_INTERNAL_MODULE
+
+/* Log call of a rate limited call site.  SendTrace is passed the level
+ * evaluated by the call site in place of its first argument.
+ */
+#define LOG_INTERNAL_CALL_SendTrace(log, level, first, ...)                  \
+  (log).SendTrace(level, __VA_ARGS__)
+#define LOG_INTERNAL_CALL_Trace(log, level, ...) (log).Trace(__VA_ARGS__)
+#define LOG_INTERNAL_CALL_Debug(log, level, ...) (log).Debug(__VA_ARGS__)
+#define LOG_INTERNAL_CALL_Info(log, level, ...) (log).Info(__VA_ARGS__)
+#define LOG_INTERNAL_CALL_Warn(log, level, ...) (log).Warn(__VA_ARGS__)
+#define LOG_INTERNAL_CALL_Warning(log, level, ...) (log).Warning(__VA_ARGS__)
+#define LOG_INTERNAL_CALL_Error(log, level, ...) (log).Error(__VA_ARGS__)
+#define LOG_INTERNAL_CALL_Critical(log, level, ...) (log).Critical(__VA_ARGS__)
+#define LOG_INTERNAL_CALL_Crit(log, level, ...) (log).Crit(__VA_ARGS__)
+#define LOG_INTERNAL_CALL_Count(log, level, ...) (log).Count(__VA_ARGS__)
+
+#define LOG_INTERNAL_RATE_LIMITED(log, decide, method, ...)                  \
+  do {                                                                       \
+    static ::logging::detail::RateLimiter log_internal_limiter;              \
+    const ::logging::detail::RateLimiter::Decision log_internal_decision =   \
+        log_internal_limiter.decide;                                         \
+    if (log_internal_decision.suppressed != 0 ||                             \
+        log_internal_decision.pass) {                                        \
+      const ::logging::Level log_internal_level =                            \
+          BOOST_PP_CAT(LOG_INTERNAL_LEVEL_, method)(__VA_ARGS__);            \
+      if (log_internal_decision.suppressed != 0) {                           \
+        (log).ReportSuppressed(                                              \
+            log_internal_level,                                              \
+            BOOST_PP_CAT(LOG_INTERNAL_MODULE_, method)(__VA_ARGS__),         \
+            log_internal_decision.suppressed);                               \
+      }                                                                      \
+      if (log_internal_decision.pass) {                                      \
+        BOOST_PP_CAT(LOG_INTERNAL_CALL_, method)(log, log_internal_level,    \
+                                                 __VA_ARGS__);               \
+      }                                                                      \
+    }                                                                        \
+  } while (false)
+// clang-format on
+
+/**
+ * @brief Rate limited Log calls.  Each call site keeps its own count.
+ * Suppressed calls evaluate neither the format nor the arguments.  Except
+ * for LOG_EVERY_N, the number of suppressed messages is logged from the call
+ * site at the same level and to the same module: by LOG_FIRST_N each time it
+ * doubles, and by LOG_EVERY_T and LOG_SAMPLED with the next message logged.
+ * So the messages suppressed after the last one logged are never reported,
+ * which for LOG_SAMPLED with probability 0 is all of them.  The first two
+ * arguments of the call, three for SendTrace, must not hold unparenthesized
+ * commas:
+ * @code
+ * LOG_EVERY_N(log, 100, Warning, "Queue full, dropping packet {}", id);
+ * LOG_EVERY_T(log, std::chrono::seconds(1), Error, mh, "Timeout");
+ * LOG_SAMPLED(log, 0.01, SendTrace, Level::DEBUG, mh, "Sample {}", value);
+ * @endcode
+ */
+#define LOG_EVERY_N(log, n, method, ...) \
+  LOG_INTERNAL_RATE_LIMITED(log, EveryN(n), method, __VA_ARGS__)
+#define LOG_FIRST_N(log, n, method, ...) \
+  LOG_INTERNAL_RATE_LIMITED(log, FirstN(n), method, __VA_ARGS__)
+#define LOG_EVERY_T(log, duration, method, ...)                             \
+  LOG_INTERNAL_RATE_LIMITED(                                                \
+      log,                                                                  \
+      EveryT(                                                               \
+          std::chrono::duration_cast<std::chrono::nanoseconds>(duration)), \
+      method, __VA_ARGS__)
+#define LOG_SAMPLED(log, probability, method, ...) \
+  LOG_INTERNAL_RATE_LIMITED(log, Sampled(probability), method, __VA_ARGS__)
+
+#endif /* SRC_LOGGERV2_RATELIMIT_HPP_ */
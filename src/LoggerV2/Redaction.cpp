@@ -0,0 +1,449 @@
+/******************************************************************************
+ * Redaction.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#include "LoggerV2/Redaction.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* defined(__AVX2__) */
+
+namespace logging {
+
+namespace detail {
+
+namespace {
+
+inline bool IsDigit(const char c) noexcept { return c >= '0' && c <= '9'; }
+
+inline bool IsAlnum(const char c) noexcept {
+  return IsDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+inline bool IsTokenChar(const char c) noexcept {
+  return IsAlnum(c) || (c != '\0' && std::strchr("._~+/=-", c) != nullptr);
+}
+
+inline bool IsLocalChar(const char c) noexcept {
+  return IsAlnum(c) || (c != '\0' && std::strchr("._%+-", c) != nullptr);
+}
+
+inline bool IsDomainChar(const char c) noexcept {
+  return IsAlnum(c) || c == '.' || c == '-';
+}
+
+/* Luhn check of the digits of a card number, in order. */
+bool Luhn(char* const* digits, const std::size_t count) noexcept {
+  unsigned sum = 0;
+  for (std::size_t i = 0; i < count; ++i) {
+    unsigned digit = static_cast<unsigned>(*digits[count - 1 - i] - '0');
+    if (i % 2 == 1) {
+      digit *= 2;
+      digit -= digit > 9 ? 9 : 0;
+    }
+    sum += digit;
+  }
+  return sum % 10 == 0;
+}
+
+/* Clears the bits of a chunk's candidate mask before position. */
+inline std::uint32_t From(const std::uint32_t mask, const char* const chunk,
+                          const char* const position,
+                          const std::ptrdiff_t width) noexcept {
+  if (position <= chunk) {
+    return mask;
+  }
+  return position - chunk >= width
+             ? 0
+             : mask & (~std::uint32_t{0} << (position - chunk));
+}
+
+/* Marks the digits that start a number, those not preceded by a letter or
+ * a digit.  Bit i of the masks is byte i of a chunk, and digits has the
+ * bytes that start a group of four digits. */
+inline std::uint32_t NumberStarts(const std::uint32_t digits,
+                                  const std::uint32_t alnums,
+                                  const bool after_alnum) noexcept {
+  return digits & ~((alnums << 1) | static_cast<std::uint32_t>(after_alnum));
+}
+
+#if defined(__AVX2__)
+/* Bytes whose distance from the first byte of a range is within it */
+inline __m256i InRange(const __m256i bytes, const char first,
+                       const char size) noexcept {
+  return _mm256_cmpeq_epi8(
+      _mm256_subs_epu8(_mm256_sub_epi8(bytes, _mm256_set1_epi8(first)),
+                       _mm256_set1_epi8(static_cast<char>(size - 1))),
+      _mm256_setzero_si256());
+}
+inline __m256i Digits(const __m256i bytes) noexcept {
+  return InRange(bytes, '0', 10);
+}
+inline __m256i Alnums(const __m256i bytes) noexcept {
+  return _mm256_or_si256(
+      Digits(bytes),
+      InRange(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 26));
+}
+#endif /* defined(__AVX2__) */
+
+#if defined(__SSE2__)
+inline __m128i InRange(const __m128i bytes, const char first,
+                       const char size) noexcept {
+  return _mm_cmpeq_epi8(
+      _mm_subs_epu8(_mm_sub_epi8(bytes, _mm_set1_epi8(first)),
+                    _mm_set1_epi8(static_cast<char>(size - 1))),
+      _mm_setzero_si128());
+}
+inline __m128i Digits(const __m128i bytes) noexcept {
+  return InRange(bytes, '0', 10);
+}
+inline __m128i Alnums(const __m128i bytes) noexcept {
+  return _mm_or_si128(Digits(bytes),
+                      InRange(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a',
+                              26));
+}
+#endif /* defined(__SSE2__) */
+
+} /* namespace */
+
+/**
+ * @brief Patterns compiled by SetRedactionPatterns
+ *
+ * Each message is scanned for anchors: the first two bytes of the literal
+ * and prefix patterns, '@' for e-mail addresses and the first digits of
+ * numbers for card numbers.  Up to kMaxAnchors anchors are compared a whole
+ * vector at a time, and the patterns are only checked where one is found.
+ * With more anchors, or without SSE2, a lookup table of first bytes is used
+ * instead.
+ */
+class Redactor {
+ public:
+  static inline constexpr std::size_t kMaxAnchors = 8;
+  static inline constexpr std::size_t kMaxCardDigits = 19;
+  static inline constexpr std::size_t kMinCardDigits = 13;
+  /* Shortest first group of digits of a card number */
+  static inline constexpr std::size_t kCardGroup = 4;
+  static inline constexpr std::ptrdiff_t kLookahead = kCardGroup - 1;
+
+  explicit Redactor(const std::vector<RedactionPattern>& patterns);
+
+  void Apply(char* data, char* end) const noexcept;
+
+ private:
+  struct Literal {
+    std::string text;
+    bool prefix;
+  };
+  /* A byte, followed by a second byte if pair is set */
+  struct Anchor {
+    char first;
+    char second;
+    bool pair;
+  };
+
+  void AddAnchor(const Anchor anchor) noexcept;
+  /* Masks the match at a candidate byte, if any, and returns where the
+   * scan resumes. */
+  char* Match(char* begin, char* position, char* end) const noexcept;
+  char* MaskEmail(char* begin, char* at, char* end) const noexcept;
+  char* MaskCardNumber(char* begin, char* position, char* end) const noexcept;
+
+  /* Literals sorted by first byte, those starting with byte b are
+   * [first_[b], first_[b + 1]). */
+  std::vector<Literal> literals_;
+  std::array<std::uint16_t, 257> first_{};
+  std::array<bool, 256> candidate_{};
+  std::array<Anchor, kMaxAnchors> anchors_{};
+  std::size_t anchor_count_ = 0;
+  bool vectorized_ = true;
+  bool emails_ = false;
+  bool card_numbers_ = false;
+};
+
+Redactor::Redactor(const std::vector<RedactionPattern>& patterns) {
+  for (const RedactionPattern& pattern : patterns) {
+    const std::string& text = pattern.text;
+    switch (pattern.kind) {
+      case RedactionKind::kLiteral:
+      case RedactionKind::kPrefix:
+        if (!text.empty()) {
+          literals_.push_back({text, pattern.kind == RedactionKind::kPrefix});
+          candidate_[static_cast<unsigned char>(text[0])] = true;
+          AddAnchor({text[0], text.size() > 1 ? text[1] : '\0',
+                     text.size() > 1});
+        }
+        break;
+      case RedactionKind::kEmail:
+        emails_ = true;
+        candidate_['@'] = true;
+        AddAnchor({'@', '\0', false});
+        break;
+      case RedactionKind::kCardNumber:
+        card_numbers_ = true;
+        std::fill(candidate_.begin() + '0', candidate_.begin() + '9' + 1,
+                  true);
+        break;
+    }
+  }
+  /* Longer literals first, so that the longest match wins. */
+  std::stable_sort(literals_.begin(), literals_.end(),
+                   [](const Literal& lhs, const Literal& rhs) {
+                     const auto l = static_cast<unsigned char>(lhs.text[0]);
+                     const auto r = static_cast<unsigned char>(rhs.text[0]);
+                     return l != r ? l < r : lhs.text.size() > rhs.text.size();
+                   });
+  for (const Literal& literal : literals_) {
+    ++first_[static_cast<unsigned char>(literal.text[0]) + 1];
+  }
+  for (std::size_t byte = 0; byte < 256; ++byte) {
+    first_[byte + 1] += first_[byte];
+  }
+}
+
+void Redactor::AddAnchor(const Anchor anchor) noexcept {
+  for (std::size_t i = 0; i < std::min(anchor_count_, kMaxAnchors); ++i) {
+    const Anchor& other = anchors_[i];
+    if (other.first == anchor.first && other.pair == anchor.pair &&
+        (!anchor.pair || other.second == anchor.second)) {
+      return;
+    }
+  }
+  if (anchor_count_ < kMaxAnchors) {
+    anchors_[anchor_count_] = anchor;
+  }
+  ++anchor_count_;
+  vectorized_ = anchor_count_ <= kMaxAnchors;
+}
+
+void Redactor::Apply(char* const data, char* const end) const noexcept {
+  char* chunk = data;
+  char* position = data;
+#if defined(__AVX2__)
+  if (vectorized_) {
+    /* Single bytes match any second byte. */
+    __m256i firsts[kMaxAnchors];
+    __m256i seconds[kMaxAnchors];
+    for (std::size_t i = 0; i < anchor_count_; ++i) {
+      firsts[i] = _mm256_set1_epi8(anchors_[i].first);
+      seconds[i] = anchors_[i].pair ? _mm256_set1_epi8(anchors_[i].second)
+                                     : _mm256_set1_epi8(-1);
+    }
+    const __m256i all = _mm256_set1_epi8(-1);
+    /* Anchors and numbers look up to kLookahead bytes past the chunk. */
+    for (; end - chunk >= 32 + kLookahead; chunk += 32) {
+      const __m256i bytes =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk));
+      const __m256i next =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk + 1));
+      __m256i hits = _mm256_setzero_si256();
+      for (std::size_t i = 0; i < anchor_count_; ++i) {
+        hits = _mm256_or_si256(
+            hits, _mm256_and_si256(
+                      _mm256_cmpeq_epi8(bytes, firsts[i]),
+                      _mm256_or_si256(_mm256_cmpeq_epi8(next, seconds[i]),
+                                      _mm256_cmpeq_epi8(seconds[i], all))));
+      }
+      auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(hits));
+      if (card_numbers_) {
+        __m256i digits = _mm256_and_si256(Digits(bytes), Digits(next));
+        for (std::ptrdiff_t i = 2; i <= kLookahead; ++i) {
+          digits = _mm256_and_si256(
+              digits, Digits(_mm256_loadu_si256(
+                          reinterpret_cast<const __m256i*>(chunk + i))));
+        }
+        mask |= NumberStarts(
+            static_cast<std::uint32_t>(_mm256_movemask_epi8(digits)),
+            static_cast<std::uint32_t>(_mm256_movemask_epi8(Alnums(bytes))),
+            chunk != data && IsAlnum(chunk[-1]));
+      }
+      for (std::uint32_t left = From(mask, chunk, position, 32); left != 0;
+           left = From(left, chunk, position, 32)) {
+        position = Match(data, chunk + __builtin_ctz(left), end);
+      }
+    }
+  }
+#endif /* defined(__AVX2__) */
+#if defined(__SSE2__)
+  if (vectorized_) {
+    __m128i firsts[kMaxAnchors];
+    __m128i seconds[kMaxAnchors];
+    for (std::size_t i = 0; i < anchor_count_; ++i) {
+      firsts[i] = _mm_set1_epi8(anchors_[i].first);
+      seconds[i] = anchors_[i].pair ? _mm_set1_epi8(anchors_[i].second)
+                                    : _mm_set1_epi8(-1);
+    }
+    const __m128i all = _mm_set1_epi8(-1);
+    for (; end - chunk >= 16 + kLookahead; chunk += 16) {
+      const __m128i bytes =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk));
+      const __m128i next =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk + 1));
+      __m128i hits = _mm_setzero_si128();
+      for (std::size_t i = 0; i < anchor_count_; ++i) {
+        hits = _mm_or_si128(
+            hits,
+            _mm_and_si128(_mm_cmpeq_epi8(bytes, firsts[i]),
+                          _mm_or_si128(_mm_cmpeq_epi8(next, seconds[i]),
+                                       _mm_cmpeq_epi8(seconds[i], all))));
+      }
+      auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(hits));
+      if (card_numbers_) {
+        __m128i digits = _mm_and_si128(Digits(bytes), Digits(next));
+        for (std::ptrdiff_t i = 2; i <= kLookahead; ++i) {
+          digits = _mm_and_si128(
+              digits, Digits(_mm_loadu_si128(
+                          reinterpret_cast<const __m128i*>(chunk + i))));
+        }
+        mask |= NumberStarts(
+            static_cast<std::uint32_t>(_mm_movemask_epi8(digits)),
+            static_cast<std::uint32_t>(_mm_movemask_epi8(Alnums(bytes))),
+            chunk != data && IsAlnum(chunk[-1]));
+      }
+      for (std::uint32_t left = From(mask, chunk, position, 16); left != 0;
+           left = From(left, chunk, position, 16)) {
+        position = Match(data, chunk + __builtin_ctz(left), end);
+      }
+    }
+  }
+#endif /* defined(__SSE2__) */
+  for (position = std::max(position, chunk); position < end;) {
+    if (candidate_[static_cast<unsigned char>(*position)]) {
+      position = Match(data, position, end);
+    } else {
+      ++position;
+    }
+  }
+}
+
+char* Redactor::Match(char* const begin, char* const position,
+                      char* const end) const noexcept {
+  const auto byte = static_cast<unsigned char>(*position);
+  for (std::size_t i = first_[byte]; i < first_[byte + 1]; ++i) {
+    const Literal& literal = literals_[i];
+    const std::size_t size = literal.text.size();
+    if (static_cast<std::size_t>(end - position) < size ||
+        std::memcmp(position, literal.text.data(), size) != 0) {
+      continue;
+    }
+    char* const token = position + size;
+    if (!literal.prefix) {
+      std::fill(position, token, '*');
+      return token;
+    }
+    char* token_end = token;
+    while (token_end < end && IsTokenChar(*token_end)) {
+      ++token_end;
+    }
+    if (token_end != token) {
+      std::fill(token, token_end, '*');
+      return token_end;
+    }
+  }
+  if (emails_ && byte == '@') {
+    if (char* const next = MaskEmail(begin, position, end)) {
+      return next;
+    }
+  }
+  if (card_numbers_ && IsDigit(*position)) {
+    return MaskCardNumber(begin, position, end);
+  }
+  return position + 1;
+}
+
+char* Redactor::MaskEmail(char* const begin, char* const at,
+                          char* const end) const noexcept {
+  char* local = at;
+  while (local > begin && IsLocalChar(local[-1])) {
+    --local;
+  }
+  char* domain_end = at + 1;
+  while (domain_end < end && IsDomainChar(*domain_end)) {
+    ++domain_end;
+  }
+  /* A sentence may end right after the address. */
+  while (domain_end > at + 1 &&
+         (domain_end[-1] == '.' || domain_end[-1] == '-')) {
+    --domain_end;
+  }
+  const char* const dot = std::find(at + 1, domain_end, '.');
+  if (local == at || dot == at + 1 || dot == domain_end) {
+    return nullptr;
+  }
+  std::fill(local, domain_end, '*');
+  return domain_end;
+}
+
+char* Redactor::MaskCardNumber(char* const begin, char* const position,
+                               char* const end) const noexcept {
+  std::array<char*, kMaxCardDigits> digits;
+  std::size_t count = 0;
+  std::size_t group = 0;
+  char* next = position;
+  /* Digits, with single spaces or dashes between them */
+  while (next < end) {
+    if (IsDigit(*next)) {
+      if (count < kMaxCardDigits) {
+        digits[count] = next;
+      }
+      ++count;
+      ++next;
+    } else if ((*next == ' ' || *next == '-') && next + 1 < end &&
+               IsDigit(next[1])) {
+      group = group == 0 ? count : group;
+      ++next;
+    } else {
+      break;
+    }
+  }
+  group = group == 0 ? count : group;
+  if (count >= kMinCardDigits && count <= kMaxCardDigits &&
+      group >= kCardGroup &&
+      (position == begin || !IsAlnum(position[-1])) &&
+      (next == end || !IsAlnum(*next)) && Luhn(digits.data(), count)) {
+    for (std::size_t i = 0; i + 4 < count; ++i) {
+      *digits[i] = '*';
+    }
+  }
+  return next;
+}
+
+void Redact(char* data, const std::size_t size) noexcept {
+  const Redactor* const current = redactor.load(std::memory_order_acquire);
+  if (current != nullptr) {
+    current->Apply(data, data + size);
+  }
+}
+
+} /* namespace detail */
+
+void SetRedactionPatterns(const std::vector<RedactionPattern>& patterns) {
+  /* Threads may still be scanning with the previous patterns, so compiled
+   * patterns are never destroyed. */
+  const detail::Redactor* const current =
+      patterns.empty() ? nullptr : new detail::Redactor(patterns);
+  detail::redactor.store(current, std::memory_order_release);
+}
+
+} /* namespace logging */
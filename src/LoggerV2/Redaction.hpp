@@ -0,0 +1,93 @@
+/******************************************************************************
+ * Redaction.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_REDACTION_HPP_
+#define SRC_LOGGERV2_REDACTION_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LoggerV2/Message.hpp"
+
+namespace logging {
+
+/** @brief What a redaction pattern masks */
+enum class RedactionKind : std::uint8_t {
+  /** @brief Every occurrence of the text */
+  kLiteral,
+  /** @brief The token following the text, such as "Bearer " or "ghp_" */
+  kPrefix,
+  /** @brief E-mail addresses, the text is unused */
+  kEmail,
+  /**
+   * @brief Card numbers of 13 to 19 digits that pass the Luhn check,
+   * except their last four digits.  The digits may be grouped by single
+   * spaces or dashes, the first group being at least four digits long.  The
+   * text is unused.
+   */
+  kCardNumber,
+};
+
+/** @brief A pattern of secrets to mask, see SetRedactionPatterns */
+struct RedactionPattern {
+  RedactionKind kind;
+  std::string text;
+};
+
+/**
+ * @brief Sets the secrets masked in the messages of the channels and modules
+ * that turned redaction on with Log::SetRedaction.
+ *
+ * The patterns are compiled once into a matcher that scans each message for
+ * the first two bytes of the patterns, 16 or 32 bytes at a time when SSE2 or
+ * AVX2 is available, and only checks the patterns where they are found.
+ * Matches are overwritten with '*' in place, so the size of a message never
+ * changes.  A token of a kPrefix pattern is a run of letters, digits and
+ * "._~+/=-".
+ * @code
+ * logging::SetRedactionPatterns({{RedactionKind::kPrefix, "Bearer "},
+ *                                {RedactionKind::kEmail, ""}});
+ * log.SetRedaction(Level::TRACE);
+ * @endcode
+ *
+ * @param patterns Replace the previous patterns, none turns redaction off
+ */
+void SetRedactionPatterns(const std::vector<RedactionPattern>& patterns);
+
+namespace detail {
+
+class Redactor;
+
+/* Compiled patterns, or nullptr when there are none. */
+inline std::atomic<const Redactor*> redactor{nullptr};
+
+/** @brief Masks the secrets in a message, see SetRedactionPatterns */
+void Redact(char* data, const std::size_t size) noexcept;
+inline void Redact(MessageBuffer& message) noexcept {
+  Redact(message.data(), message.size());
+}
+
+} /* namespace detail */
+
+} /* namespace logging */
+
+#endif /* SRC_LOGGERV2_REDACTION_HPP_ */
@@ -0,0 +1,165 @@
+/******************************************************************************
+ * SourceName.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_SOURCENAME_HPP_
+#define SRC_LOGGERV2_SOURCENAME_HPP_
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+
+/* How Log calls send file names (0 = full path, 1 = relative to
+ * LOG_SOURCE_ROOT, 2 = basename).  LOG_SITE trims them at compile time.
+ * Other Log calls trim them as they are sent, as a default argument cannot
+ * be trimmed at compile time and still take the file of the caller. */
+#ifndef LOG_FILE_NAMES
+#define LOG_FILE_NAMES 1
+#endif /* LOG_FILE_NAMES */
+
+/* Prefix removed from file names by LOG_FILE_NAMES=1, with its trailing
+ * slash.  Files outside of it keep their full path. */
+#ifndef LOG_SOURCE_ROOT
+#define LOG_SOURCE_ROOT ""
+#endif /* LOG_SOURCE_ROOT */
+
+/* How LOG_SITE sends function names (0 = full signature, 1 = qualified name,
+ * 2 = unqualified name).  Other Log calls send the unqualified name given by
+ * __builtin_FUNCTION, as the signature is only known to the function. */
+#ifndef LOG_SITE_FUNCTION_NAMES
+#define LOG_SITE_FUNCTION_NAMES 2
+#endif /* LOG_SITE_FUNCTION_NAMES */
+
+namespace logging::detail {
+
+enum class FileNames { kFull, kRelative, kBase };
+enum class FunctionNames { kFull, kQualified, kName };
+
+inline constexpr FileNames kFileNames = static_cast<FileNames>(LOG_FILE_NAMES);
+inline constexpr FunctionNames kFunctionNames =
+    static_cast<FunctionNames>(LOG_SITE_FUNCTION_NAMES);
+
+/**
+ * @brief Trims a file name as configured by LOG_FILE_NAMES.  The result
+ * points into the same string, so no copy is stored.
+ */
+constexpr const char* TrimFileName(
+    const char* file, const FileNames mode = kFileNames,
+    const std::string_view root = LOG_SOURCE_ROOT) noexcept {
+  const std::string_view path(file);
+  switch (mode) {
+    case FileNames::kFull:
+      return file;
+    case FileNames::kRelative:
+      return (!root.empty() && path.starts_with(root)) ? file + root.size()
+                                                       : file;
+    case FileNames::kBase:
+      const std::size_t slash = path.find_last_of("/\\");
+      return (slash == std::string_view::npos) ? file : file + slash + 1;
+  }
+  return file;
+}
+
+/**
+ * @brief Simplifies a __PRETTY_FUNCTION__ signature as configured by
+ * LOG_SITE_FUNCTION_NAMES.
+ *
+ * The qualified name drops the return type, the parameter list, trailing
+ * qualifiers and the " [with T = ...]" summary of templates.  The unqualified
+ * name also drops namespaces and classes, which cannot be told apart in the
+ * signature.  Lambdas keep the name of their enclosing function.
+ */
+constexpr std::string_view SimplifyFunctionName(
+    std::string_view pretty,
+    const FunctionNames mode = kFunctionNames) noexcept {
+  if (mode == FunctionNames::kFull) {
+    return pretty;
+  }
+  if (pretty.ends_with(']')) {
+    const std::size_t with = pretty.rfind(" [with ");
+    if (with != std::string_view::npos) {
+      pretty = pretty.substr(0, with);
+    }
+  }
+  /* Parameter list, unless the name ends in a lambda */
+  const std::size_t close = pretty.rfind(')');
+  if (close != std::string_view::npos &&
+      pretty.find_first_not_of("abcdefghijklmnopqrstuvwxyz &", close + 1) ==
+          std::string_view::npos) {
+    int depth = 0;
+    for (std::size_t i = close + 1; i-- > 0;) {
+      depth += (pretty[i] == ')') ? 1 : (pretty[i] == '(') ? -1 : 0;
+      if (depth == 0) {
+        pretty = pretty.substr(0, i);
+        break;
+      }
+    }
+  }
+  /* Return type, up to the last space outside of brackets, except the one
+   * of a conversion operator */
+  std::size_t start = 0;
+  int depth = 0;
+  for (std::size_t i = 0; i < pretty.size(); ++i) {
+    const char c = pretty[i];
+    if (c == '<' || c == '(' || c == '[') {
+      ++depth;
+    } else if (c == '>' || c == ')' || c == ']') {
+      --depth;
+    } else if (c == ' ' && depth == 0 &&
+               !pretty.substr(0, i).ends_with("operator")) {
+      start = i + 1;
+    }
+  }
+  pretty = pretty.substr(start);
+  if (mode == FunctionNames::kQualified) {
+    return pretty;
+  }
+  /* Last scope, or the last two if the last one is a lambda */
+  std::size_t last = 0;
+  std::size_t previous = 0;
+  depth = 0;
+  for (std::size_t i = 0; i + 1 < pretty.size(); ++i) {
+    const char c = pretty[i];
+    if (c == '<' || c == '(' || c == '[') {
+      ++depth;
+    } else if (c == '>' || c == ')' || c == ']') {
+      --depth;
+    } else if (c == ':' && pretty[i + 1] == ':' && depth == 0) {
+      previous = last;
+      last = i + 2;
+      ++i;
+    }
+  }
+  return pretty.substr(pretty.substr(last).starts_with('<') ? previous
+                                                           : last);
+}
+
+/** @brief Copies a simplified function name into static storage */
+template <std::size_t N>
+constexpr std::array<char, N + 1> StoreName(
+    const std::string_view name) noexcept {
+  std::array<char, N + 1> stored{};
+  for (std::size_t i = 0; i < N; ++i) {
+    stored[i] = name[i];
+  }
+  return stored;
+}
+
+} /* namespace logging::detail */
+
+#endif /* SRC_LOGGERV2_SOURCENAME_HPP_ */
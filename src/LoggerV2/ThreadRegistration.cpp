@@ -0,0 +1,109 @@
+/******************************************************************************
+ * ThreadRegistration.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/ThreadRegistration.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "P7_Trace.h"
+
+#if defined(unix) || defined(__unix__) || defined(__unix)
+#define PREDEF_PLATFORM_UNIX
+#endif /* unix */
+
+#ifdef PREDEF_PLATFORM_UNIX
+#include <pthread.h>
+#endif /* PREDEF_PLATFORM_UNIX */
+
+namespace logging::detail {
+
+namespace {
+
+/* Channels the calling thread is registered with.  Channels live for the
+ * rest of the process, see GetChannel, so they can be used at thread exit.
+ */
+struct Registrations {
+  ~Registrations() {
+    for (IP7_Trace* trace : traces) {
+      trace->Unregister_Thread(0);
+    }
+    registered_trace = nullptr;
+    exited = true;
+  }
+
+  bool Contains(IP7_Trace* trace) const {
+    return std::find(traces.begin(), traces.end(), trace) != traces.end();
+  }
+
+  std::vector<IP7_Trace*> traces;
+  /* Set once destroyed, for messages from later thread_local destructors */
+  static inline thread_local bool exited = false;
+};
+
+thread_local Registrations registrations;
+
+} /* namespace */
+
+void RegisterThreadSlow(IP7_Trace* trace) {
+  if (Registrations::exited) {
+    return;
+  }
+  if (!registrations.Contains(trace)) {
+    /* Linux limits thread names to 15 characters. */
+    char name[16] = "Unnamed thread";
+#ifdef PREDEF_PLATFORM_UNIX
+    char thread_name[sizeof(name)] = "";
+    if (pthread_getname_np(pthread_self(), thread_name,
+                           sizeof(thread_name)) == 0 &&
+        thread_name[0] != '\0') {
+      std::copy(std::begin(thread_name), std::end(thread_name), name);
+    }
+#endif /* PREDEF_PLATFORM_UNIX */
+    RegisterThread(trace, name);
+  }
+  /* Not retried if P7 failed, so that failures cost nothing either. */
+  registered_trace = trace;
+}
+
+bool RegisterThread(IP7_Trace* trace, const char* name) {
+  if (!trace->Register_Thread(name, 0)) {
+    return false;
+  }
+  if (!Registrations::exited && !registrations.Contains(trace)) {
+    registrations.traces.push_back(trace);
+  }
+  return true;
+}
+
+bool UnregisterThread(IP7_Trace* trace) {
+  if (!Registrations::exited) {
+    auto& traces = registrations.traces;
+    traces.erase(std::remove(traces.begin(), traces.end(), trace),
+                 traces.end());
+  }
+  if (registered_trace == trace) {
+    registered_trace = nullptr;
+  }
+  return trace->Unregister_Thread(0);
+}
+
+} /* namespace logging::detail */
@@ -0,0 +1,54 @@
+/******************************************************************************
+ * ThreadRegistration.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_THREADREGISTRATION_HPP_
+#define SRC_LOGGERV2_THREADREGISTRATION_HPP_
+
+#include <cstdint>
+
+#include "P7_Trace.h"
+
+namespace logging::detail {
+
+/** @brief The channel the calling thread logged to last */
+inline thread_local IP7_Trace* registered_trace = nullptr;
+
+/**
+ * @brief Registers the calling thread with a channel under its pthread name,
+ * unless it already is.  Threads are unregistered from their channels when
+ * they exit.
+ */
+void RegisterThreadSlow(IP7_Trace* trace);
+
+/** @brief Registers the calling thread on its first message to a channel */
+inline void AutoRegisterThread(IP7_Trace* trace) {
+  if (trace != registered_trace) {
+    RegisterThreadSlow(trace);
+  }
+}
+
+/** @brief Registers the calling thread with a channel under a given name */
+bool RegisterThread(IP7_Trace* trace, const char* name);
+
+/** @brief Unregisters the calling thread from a channel */
+bool UnregisterThread(IP7_Trace* trace);
+
+} /* namespace logging::detail */
+
+#endif /* SRC_LOGGERV2_THREADREGISTRATION_HPP_ */
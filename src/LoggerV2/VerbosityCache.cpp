@@ -0,0 +1,144 @@
+/******************************************************************************
+ * VerbosityCache.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/VerbosityCache.hpp"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "P7_Trace.h"
+
+namespace logging::detail {
+
+namespace {
+/* Never destroyed, as the exit handler creates a Log after static
+ * destruction.
+ */
+std::mutex& RegistryMutex() {
+  static auto* registry_mutex = new std::mutex;
+  return *registry_mutex;
+}
+std::map<IP7_Trace*, std::unique_ptr<VerbosityCache>>& Registry() {
+  static auto* registry =
+      new std::map<IP7_Trace*, std::unique_ptr<VerbosityCache>>;
+  return *registry;
+}
+} /* namespace */
+
+VerbosityCache::VerbosityCache(const std::uint8_t initial) noexcept {
+  for (auto& level : levels_) {
+    level.store(initial, std::memory_order_relaxed);
+  }
+  for (auto& level : redact_levels_) {
+    level.store(kDisabled, std::memory_order_relaxed);
+  }
+  levels_[kOverflowSlot].store(initial == kDisabled ? kDisabled : 0,
+                               std::memory_order_relaxed);
+  min_level_.store(initial, std::memory_order_relaxed);
+}
+
+std::uint16_t VerbosityCache::Register(const IP7_Trace::hModule module,
+                                       const std::uint8_t level) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (std::size_t slot = 1; slot < module_count_; ++slot) {
+    if (modules_[slot] == module) {
+      levels_[slot].store(level, std::memory_order_relaxed);
+      UpdateMinLevel();
+      return static_cast<std::uint16_t>(slot);
+    }
+  }
+  if (module_count_ > kMaxModules) {
+    overflowed_ = true;
+    UpdateMinLevel();
+    return kOverflowSlot;
+  }
+  const std::size_t slot = module_count_++;
+  modules_[slot] = module;
+  levels_[slot].store(level, std::memory_order_relaxed);
+  UpdateMinLevel();
+  return static_cast<std::uint16_t>(slot);
+}
+
+void VerbosityCache::Update(const IP7_Trace::hModule module,
+                            const std::uint8_t level) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (module == nullptr) {
+    levels_[kChannelSlot].store(level, std::memory_order_relaxed);
+    UpdateMinLevel();
+    return;
+  }
+  for (std::size_t slot = 1; slot < module_count_; ++slot) {
+    if (modules_[slot] == module) {
+      levels_[slot].store(level, std::memory_order_relaxed);
+      UpdateMinLevel();
+      return;
+    }
+  }
+}
+
+void VerbosityCache::UpdateMinLevel() noexcept {
+  std::uint8_t min_level = overflowed_
+                               ? levels_[kOverflowSlot].load(
+                                     std::memory_order_relaxed)
+                               : kDisabled;
+  for (std::size_t slot = 0; slot < module_count_; ++slot) {
+    min_level = std::min(min_level,
+                         levels_[slot].load(std::memory_order_relaxed));
+  }
+  min_level_.store(min_level, std::memory_order_relaxed);
+}
+
+VerbosityCache* VerbosityCache::ForChannel(IP7_Trace* trace) {
+  std::lock_guard<std::mutex> lock(RegistryMutex());
+  auto& cache = Registry()[trace];
+  if (cache == nullptr) {
+    cache = std::make_unique<VerbosityCache>(
+        static_cast<std::uint8_t>(trace->Get_Verbosity(nullptr)));
+  }
+  return cache.get();
+}
+
+VerbosityCache* VerbosityCache::Attach(IP7_Trace* trace,
+                                       std::unique_ptr<VerbosityCache> cache) {
+  cache->Update(nullptr,
+                static_cast<std::uint8_t>(trace->Get_Verbosity(nullptr)));
+  std::lock_guard<std::mutex> lock(RegistryMutex());
+  auto& entry = Registry()[trace];
+  entry = std::move(cache);
+  return entry.get();
+}
+
+VerbosityCache* VerbosityCache::Disabled() noexcept {
+  static VerbosityCache disabled(kDisabled);
+  return &disabled;
+}
+
+void VerbosityCache::OnVerbosityChanged(void* context,
+                                        IP7_Trace::hModule module,
+                                        eP7Trace_Level level) {
+  if (context != nullptr) {
+    static_cast<VerbosityCache*>(context)->Update(
+        module, static_cast<std::uint8_t>(level));
+  }
+}
+
+} /* namespace logging::detail */
@@ -0,0 +1,169 @@
+/******************************************************************************
+ * VerbosityCache.hpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+#ifndef SRC_LOGGERV2_VERBOSITYCACHE_HPP_
+#define SRC_LOGGERV2_VERBOSITYCACHE_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "P7_Trace.h"
+
+#include "LoggerV2/Message.hpp"
+
+namespace logging::detail {
+
+/**
+ * @brief Mirror of the verbosity levels of one P7 trace channel and its
+ * modules, so that disabled messages can be dropped before formatting.
+ *
+ * Slot 0 holds the channel verbosity, slots 1 to kMaxModules hold module
+ * verbosities in registration order.  Modules registered after the table is
+ * full share the overflow slot, which never filters and leaves the decision
+ * to P7.
+ *
+ * Each slot also holds the coalescing window of its module, see
+ * CoalesceMessage, and the lowest level it redacts, see
+ * SetRedactionPatterns.  The wrap policy is shared by the whole channel.
+ */
+class VerbosityCache {
+ public:
+  static inline constexpr std::size_t kMaxModules = 128;
+  static inline constexpr std::uint16_t kChannelSlot = 0;
+  static inline constexpr std::uint16_t kOverflowSlot = kMaxModules + 1;
+  /** @brief Threshold that filters every level, used when logging is off */
+  static inline constexpr std::uint8_t kDisabled = UINT8_MAX;
+
+  explicit VerbosityCache(const std::uint8_t initial) noexcept;
+
+  VerbosityCache(const VerbosityCache& rhs) = delete;
+  VerbosityCache& operator=(const VerbosityCache& rhs) = delete;
+
+  /**
+   * @brief Checks whether a message of a level passes the cached verbosity
+   *
+   * @param level Raw value of the message level
+   * @param slot Slot of the module the message is sent to
+   */
+  inline bool Enabled(const std::uint8_t level,
+                      const std::uint16_t slot) const noexcept {
+    return level >= levels_[slot].load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Checks whether a message of a level passes the verbosity of the
+   * channel or of any of its modules
+   */
+  inline bool AnyEnabled(const std::uint8_t level) const noexcept {
+    return level >= min_level_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Returns the coalescing window of a slot in nanoseconds, or 0 */
+  inline std::int64_t CoalesceWindow(const std::uint16_t slot) const noexcept {
+    return windows_[slot].load(std::memory_order_relaxed);
+  }
+
+  /** @brief Sets the coalescing window of a slot, 0 turns coalescing off */
+  inline void SetCoalesceWindow(const std::uint16_t slot,
+                                const std::int64_t window) noexcept {
+    windows_[slot].store(window, std::memory_order_relaxed);
+  }
+
+  /** @brief Checks whether messages of a level are redacted in a slot */
+  inline bool Redacts(const std::uint8_t level,
+                      const std::uint16_t slot) const noexcept {
+    return level >= redact_levels_[slot].load(std::memory_order_relaxed);
+  }
+
+  /** @brief Sets the lowest level redacted in a slot, kDisabled for none */
+  inline void SetRedactLevel(const std::uint16_t slot,
+                             const std::uint8_t level) noexcept {
+    redact_levels_[slot].store(level, std::memory_order_relaxed);
+  }
+
+  /** @brief Returns the wrap policy of the channel */
+  inline WrapPolicy wrap_policy() const noexcept {
+    return wrap_policy_.load(std::memory_order_relaxed);
+  }
+
+  /** @brief Sets the wrap policy of the channel */
+  inline void SetWrapPolicy(const WrapPolicy policy) noexcept {
+    wrap_policy_.store(policy, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Assigns a slot to a newly registered module
+   *
+   * @param module P7 module handle
+   * @param level Current verbosity of the module
+   * @return Returns the slot of the module
+   */
+  std::uint16_t Register(const IP7_Trace::hModule module,
+                         const std::uint8_t level);
+
+  /**
+   * @brief Updates the cached verbosity of a module, or of the channel if
+   * module is nullptr.  Unknown modules are ignored.
+   */
+  void Update(const IP7_Trace::hModule module, const std::uint8_t level);
+
+  /**
+   * @brief Returns the cache belonging to a trace channel, creating it on
+   * first use.  Caches live for the rest of the process.
+   */
+  static VerbosityCache* ForChannel(IP7_Trace* trace);
+
+  /**
+   * @brief Registers a cache created before its trace channel existed, so
+   * that it could be passed to P7 as the verbosity callback context.
+   */
+  static VerbosityCache* Attach(IP7_Trace* trace,
+                                std::unique_ptr<VerbosityCache> cache);
+
+  /** @brief Returns the cache used when logging is disabled */
+  static VerbosityCache* Disabled() noexcept;
+
+  /** @brief P7 verbosity callback, the context is the channel's cache */
+  static void OnVerbosityChanged(void* context, IP7_Trace::hModule module,
+                                 eP7Trace_Level level);
+
+ private:
+  std::array<std::atomic<std::uint8_t>, kMaxModules + 2> levels_;
+  std::array<std::atomic<std::int64_t>, kMaxModules + 2> windows_{};
+  std::array<std::atomic<std::uint8_t>, kMaxModules + 2> redact_levels_;
+  std::atomic<WrapPolicy> wrap_policy_{WrapPolicy{}};
+  static_assert(std::atomic<WrapPolicy>::is_always_lock_free);
+  /* Recomputes min_level_, with mutex_ held */
+  void UpdateMinLevel() noexcept;
+
+  std::array<IP7_Trace::hModule, kMaxModules + 1> modules_{};
+  std::size_t module_count_ = 1;
+  /* Lowest level of the slots in use */
+  std::atomic<std::uint8_t> min_level_;
+  bool overflowed_ = false;
+  std::mutex mutex_;
+};
+
+} /* namespace logging::detail */
+
+#endif /* SRC_LOGGERV2_VERBOSITYCACHE_HPP_ */
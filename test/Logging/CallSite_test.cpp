@@ -0,0 +1,91 @@
+/******************************************************************************
+ * CallSite_test.cpp
+ * Copyright (C) 2020  Mel McCalla <melmccalla@gmail.com>
+ *
+ * This file is part of LoggerV2.
+ *
+ * LoggerV2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * LoggerV2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with LoggerV2.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+#include "LoggerV2/CallSite.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "LoggerV2/Log.hpp"
+
+/* Sites in plain, inline and template functions of one translation unit,
+ * which GCC cannot place together in one linker section. */
+namespace {
+
+constexpr std::uint32_t kPlainLine = __LINE__ + 2;
+void PlainSite(const logging::Log& log) {
+  LOG_SITE(log, Info, "Test Plain Site");
+}
+
+constexpr std::uint32_t kInlineLine = __LINE__ + 2;
+inline void InlineSite(const logging::Log& log) {
+  LOG_SITE(log, Info, "Test Inline Site");
+}
+
+constexpr std::uint32_t kTemplateLine = __LINE__ + 3;
+template <typename T>
+void TemplateSite(const logging::Log& log, const T& value) {
+  LOG_SITE(log, Info, "Test Template Site {}", value);
+}
+
+std::vector<const logging::CallSite*> SitesAt(const std::uint32_t line) {
+  std::vector<const logging::CallSite*> sites = logging::GetCallSites();
+  std::erase_if(sites, [line](const logging::CallSite* site) {
+    return site->line != line ||
+           !std::string_view(site->file).ends_with("CallSite_test.cpp");
+  });
+  return sites;
+}
+
+}  // namespace
+
+TEST(CallSiteTest, MixedFunctionsTest) {
+  const logging::Log log("call site test");
+  /* Applies to the site once it first runs */
+  EXPECT_EQ(logging::SetSiteState(
+                "*CallSite_test.cpp:" + std::to_string(kInlineLine),
+                logging::SiteState::kDisabled),
+            0);
+  EXPECT_TRUE(SitesAt(kInlineLine).empty());
+
+  PlainSite(log);
+  InlineSite(log);
+  TemplateSite(log, 1);
+  TemplateSite(log, std::string("text"));
+  PlainSite(log);
+
+  EXPECT_EQ(SitesAt(kPlainLine).size(), 1u);
+  const auto inline_sites = SitesAt(kInlineLine);
+  ASSERT_EQ(inline_sites.size(), 1u);
+  EXPECT_EQ(inline_sites.front()->state.load(), logging::SiteState::kDisabled);
+  EXPECT_STREQ(inline_sites.front()->function, "InlineSite");
+  /* One site for each instantiation */
+  const auto template_sites = SitesAt(kTemplateLine);
+  ASSERT_EQ(template_sites.size(), 2u);
+  EXPECT_EQ(template_sites.front()->state.load(),
+            logging::SiteState::kDefault);
+
+  EXPECT_EQ(logging::SetSiteState("*Site", logging::SiteState::kDefault), 4u);
+}
@@ -20,12 +20,30 @@
 
 #include "LoggerV2/Log.hpp"
 
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
 #include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
+#include "LoggerV2/Batch.hpp"
 #include "LoggerV2/Client.hpp"
+#include "LoggerV2/Flags.hpp"
+#include "LoggerV2/LineSplitter.hpp"
+#include "LoggerV2/Redaction.hpp"
+
+ABSL_DECLARE_FLAG(logging::flags::LoggingEnabled, logging);
 
 using logging::Client;
 using logging::Level;
@@ -35,6 +53,120 @@ using logging::ModuleHandle;
 
 using src_loc = logging::CustomSourceLocation;
 
+namespace {
+std::vector<std::string> Split(const std::string_view text,
+                               const std::size_t wrap_length,
+                               const bool split_lines = true) {
+  logging::detail::LineSplitter splitter(text, wrap_length, split_lines);
+  std::vector<std::string> pieces;
+  for (std::string_view piece; splitter.Next(piece);) {
+    pieces.emplace_back(piece);
+  }
+  return pieces;
+}
+
+/* Renders fields onto a message, as the Log functions do. */
+template <typename... Fields>
+std::string Render(const std::string_view text, const Fields&... fields) {
+  logging::detail::FieldBuffer encoded;
+  logging::detail::AppendContext(encoded);
+  (logging::detail::EncodeField(encoded, fields), ...);
+  logging::MessageBuffer message;
+  message.append(text);
+  logging::detail::RenderFields(
+      std::string_view(encoded.data(), encoded.size()), message);
+  return fmt::to_string(message);
+}
+
+/* Redacts a copy of a message with the current patterns. */
+std::string Redacted(std::string text) {
+  logging::detail::Redact(text.data(), text.size());
+  return text;
+}
+}  // namespace
+
+namespace {
+/* Counts how many times it has been formatted. */
+struct FormatCounter {
+  static inline std::atomic<int> count = 0;
+};
+}  // namespace
+
+namespace {
+/* Counts how many times it has been copied. */
+struct CopyCounter {
+  CopyCounter() = default;
+  CopyCounter(const CopyCounter&) { ++copies; }
+  CopyCounter& operator=(const CopyCounter&) {
+    ++copies;
+    return *this;
+  }
+  static inline std::atomic<int> copies = 0;
+};
+}  // namespace
+
+namespace {
+/* Refers to a value it does not own, like the results of fmt::join. */
+/* Formatted as count copies of c, to encode text of a given size */
+struct Repeat {
+  char c;
+  std::size_t count;
+};
+
+struct View {
+  const int* target;
+  /* Set once the target is destroyed */
+  static inline std::atomic<bool> dangling = false;
+  static inline std::atomic<int> dangling_reads = 0;
+};
+}  // namespace
+
+/* Copying these is safe, they own what they format. */
+template <>
+inline constexpr bool logging::kCopyableArg<CopyCounter> = true;
+template <>
+inline constexpr bool logging::kCopyableArg<FormatCounter> = true;
+
+template <>
+struct fmt::formatter<Repeat> {
+  constexpr auto parse(format_parse_context& ctx) { return ctx.begin(); }
+  template <typename FormatContext>
+  auto format(const Repeat& repeat, FormatContext& ctx) {
+    return std::fill_n(ctx.out(), repeat.count, repeat.c);
+  }
+};
+
+template <>
+struct fmt::formatter<View> {
+  constexpr auto parse(format_parse_context& ctx) { return ctx.begin(); }
+  template <typename FormatContext>
+  auto format(const View& view, FormatContext& ctx) {
+    if (View::dangling) {
+      ++View::dangling_reads;
+      return fmt::format_to(ctx.out(), "dangling");
+    }
+    return fmt::format_to(ctx.out(), "{}", *view.target);
+  }
+};
+
+template <>
+struct fmt::formatter<CopyCounter> {
+  constexpr auto parse(format_parse_context& ctx) { return ctx.begin(); }
+  template <typename FormatContext>
+  auto format(const CopyCounter&, FormatContext& ctx) {
+    return fmt::format_to(ctx.out(), "{}", CopyCounter::copies.load());
+  }
+};
+
+template <>
+struct fmt::formatter<FormatCounter> {
+  constexpr auto parse(format_parse_context& ctx) { return ctx.begin(); }
+  template <typename FormatContext>
+  auto format(const FormatCounter&, FormatContext& ctx) {
+    return fmt::format_to(ctx.out(), "{}", ++FormatCounter::count);
+  }
+};
+
 class LogTest : public ::testing::Test {
  public:
   static void SetUpTestCase() {
@@ -46,8 +178,24 @@ class LogTest : public ::testing::Test {
     log_ = nullptr;
     client_ = nullptr;
   }
+  /* Restores the verbosity the test changed, so that tests can share the
+   * channel. */
+  void TearDown() override {
+    for (const ModuleHandle& handle : modules_) {
+      log_->SetVerbosity(handle, Level::TRACE);
+    }
+    log_->SetVerbosity(Level::TRACE);
+  }
+
+  /* Registers a module whose verbosity is restored after the test */
+  ModuleHandle RegisterModule(const std::string_view name) {
+    modules_.push_back(log_->RegisterModule(name).value());
+    return modules_.back();
+  }
+
   static Client* client_;
   static GELog* log_;
+  std::vector<ModuleHandle> modules_;
 
   int int_test = 5;
   long long_test = 50000000000L;
@@ -170,30 +318,838 @@ TEST_F(LogTest, CountTest) {
               pointer_test, string_test, int_test);
 }
 
+TEST_F(LogTest, MultilineTest) {
+  log_->RegisterThread("Test thread");
+
+  const std::string long_line(logging::kLineWrapLength * 2 + 10, 'x');
+  log_->Info("Test Multiline\n\nsecond line\n{}\n", long_line);
+  log_->Info("Test Oversized {}",
+             std::string(logging::kMessageBufferSize * 2, 'y'));
+}
+
+TEST_F(LogTest, VerbosityTest) {
+  log_->RegisterThread("Test thread");
+  const ModuleHandle mh = log_->RegisterModule("Verbosity Test").value();
+  const FormatCounter counter{};
+
+  log_->SetVerbosity(Level::ERROR);
+  EXPECT_FALSE(log_->IsEnabled(Level::INFO));
+  EXPECT_TRUE(log_->IsEnabled(Level::ERROR));
+  EXPECT_TRUE(log_->IsEnabled(Level::INFO, mh));
+
+  FormatCounter::count = 0;
+  log_->Info("Test Verbosity {}", counter);
+  EXPECT_EQ(FormatCounter::count.load(), 0);
+  log_->Info(mh, "Test Verbosity Module {}", counter);
+  EXPECT_EQ(FormatCounter::count.load(), 1);
+  log_->Error("Test Verbosity {}", counter);
+  EXPECT_EQ(FormatCounter::count.load(), 2);
+
+  log_->SetVerbosity(mh, Level::CRITICAL);
+  EXPECT_FALSE(log_->IsEnabled(Level::ERROR, mh));
+  log_->Error(mh, "Test Verbosity Module {}", counter);
+  EXPECT_EQ(FormatCounter::count.load(), 2);
+
+  log_->SetVerbosity(mh, Level::TRACE);
+  log_->SetVerbosity(Level::TRACE);
+  EXPECT_TRUE(log_->IsEnabled(Level::TRACE));
+}
+
+TEST_F(LogTest, MinLogLevelTest) {
+  int evaluations = 0;
+  log_->CAPTURE(++evaluations);
+  EXPECT_EQ(evaluations, logging::IsCompiledIn(Level::TRACE) ? 1 : 0);
+  EXPECT_TRUE(logging::IsCompiledIn(Level::CRITICAL));
+}
+
 TEST_F(LogTest, CaptureTest) {
   int capture1 = 100;
   int capture2 = 500;
   std::string capture3 = "Test";
   bool capture4 = true;
   short capture5 = 64;
-  //  const char* capture6 = "Test23";
-  //  long capture7 = 109230942049;
-  //  void* capture8 = (void*)0xDEADBEEF;
-  //  int capture9 = 2341452;
-  //  char capture10 = 'k';
+  const char* capture6 = "Test23";
+  long capture7 = 109230942049;
+  void* capture8 = (void*)0xDEADBEEF;
+  int capture9 = 2341452;
+  char capture10 = 'k';
 
   log_->CAPTURE(capture1);
   log_->CAPTURE(capture1, capture2);
   log_->CAPTURE(capture1, capture2, capture3);
   log_->CAPTURE(capture1, capture2, capture3, capture4);
   log_->CAPTURE(capture1, capture2, capture3, capture4, capture5);
-  //  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6);
-  //  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6,
-  //                capture7);
-  //  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6,
-  //                capture7, capture8);
-  //  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6,
-  //                capture7, capture8, capture9);
-  //  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6,
-  //                capture7, capture8, capture9, capture10);
+  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6);
+  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6,
+                capture7);
+  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6,
+                capture7, capture8);
+  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6,
+                capture7, capture8, capture9);
+  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6,
+                capture7, capture8, capture9, capture10);
+  log_->CAPTURE(capture1, capture2, capture3, capture4, capture5, capture6,
+                capture7, capture8, capture9, capture10, capture1 + 1);
+
+  const ModuleHandle mh = log_->RegisterModule("Capture Test").value();
+  log_->CAPTURE_LEVEL(Level::INFO, capture1, capture3);
+  log_->CAPTURE_MODULE(Level::ERROR, mh, capture1, std::string("temporary"));
+
+  using logging::detail::CaptureFormat;
+  EXPECT_EQ(CaptureFormat<"a">::kText.view(), "a = {}");
+  EXPECT_EQ(CaptureFormat<"a, f(b, c), x[1]">::kText.view(),
+            "a = {} | f(b, c) = {} | x[1] = {}");
+  EXPECT_EQ(CaptureFormat<"T{1}, \"a, {\", ','">::kText.view(),
+            "T{{1}} = {} | \"a, {{\" = {} | ',' = {}");
+  EXPECT_EQ(CaptureFormat<"a , b + c">::kCount, 2);
+  EXPECT_EQ(CaptureFormat<"a , b + c">::kText.view(), "a = {} | b + c = {}");
+}
+
+TEST_F(LogTest, AsyncTest) {
+  constexpr int kMessages = 1000;
+  const FormatCounter counter{};
+
+  logging::StartAsync(
+      logging::AsyncOptions{16, logging::OverflowPolicy::kBlock});
+  FormatCounter::count = 0;
+  for (int i = 0; i < kMessages; ++i) {
+    log_->Error("Test Async {} {} {}", counter, std::string(64, 'x'),
+                string_test);
+  }
+  log_->Critical("Test Async Critical {}", counter);
+  logging::StopAsync();
+
+  logging::AsyncStats stats = logging::GetAsyncStats();
+  EXPECT_EQ(stats.queued, kMessages);
+  EXPECT_EQ(stats.dropped, 0);
+  EXPECT_EQ(FormatCounter::count.load(), kMessages + 1);
+
+  logging::StartAsync(
+      logging::AsyncOptions{4, logging::OverflowPolicy::kDropNewest});
+  for (int i = 0; i < kMessages; ++i) {
+    log_->Error("Test Async Drop Newest {}", i);
+  }
+  logging::StopAsync();
+  stats = logging::GetAsyncStats();
+  EXPECT_EQ(stats.queued + stats.dropped, kMessages);
+
+  logging::StartAsync(
+      logging::AsyncOptions{4, logging::OverflowPolicy::kDropOldest});
+  for (int i = 0; i < kMessages; ++i) {
+    log_->Error("Test Async Drop Oldest {}", i);
+  }
+  logging::StopAsync();
+  stats = logging::GetAsyncStats();
+  EXPECT_EQ(stats.queued, kMessages);
+  EXPECT_LE(stats.dropped, kMessages);
+
+  /* Arguments that refer to the caller's memory are formatted before the
+   * call returns. */
+  using logging::detail::async::kQueueable;
+  static_assert(kQueueable<int> && kQueueable<const char*> &&
+                kQueueable<std::string>);
+  const std::vector<int> values{1, 2, 3};
+  static_assert(!kQueueable<View> &&
+                !kQueueable<decltype(fmt::join(values, ","))>);
+  logging::StartAsync();
+  {
+    std::vector<int> local{4, 5, 6};
+    const int target = 42;
+    log_->Info("Test Async View {} {}", View{&target}, fmt::join(local, ","));
+    log_->Info("Test Async View {} {}", View{&target}, std::string(256, 'x'));
+    View::dangling = true;
+  }
+  logging::StopAsync();
+  View::dangling = false;
+  EXPECT_EQ(View::dangling_reads.load(), 0);
+  EXPECT_EQ(logging::GetAsyncStats().queued, 2);
+
+  /* Null C strings are queued as "(null)" */
+  static std::vector<std::string> texts;
+  logging::detail::trace_observer.store(
+      [](const Level /*level*/, const char* /*file*/,
+         const std::string_view text) { texts.emplace_back(text); });
+  logging::StartAsync();
+  const char* const null_string = nullptr;
+  log_->Info("Test Async Null {}", null_string);
+  logging::StopAsync();
+  logging::detail::trace_observer.store(nullptr);
+  EXPECT_THAT(texts, ::testing::ElementsAre("Test Async Null (null)"));
+}
+
+TEST_F(LogTest, NativeFormatTest) {
+  using logging::detail::NativeFormat;
+  using namespace logging::literals;
+
+  EXPECT_STREQ((NativeFormat<"{} {} {} {} {}", int, unsigned long, double,
+                             const char*, void*>::Get()),
+               "%d %lu %g %s %p");
+  EXPECT_STREQ((NativeFormat<"100% {{done}}">::Get()), "100%% {done}");
+  EXPECT_EQ((NativeFormat<"{:x}", int>::Get()), nullptr);
+  EXPECT_EQ((NativeFormat<"{} {}", int>::Get()), nullptr);
+  EXPECT_EQ((NativeFormat<"{}\n{}", int, int>::Get()), nullptr);
+  EXPECT_EQ((NativeFormat<"{}", std::string>::Get()), nullptr);
+  EXPECT_EQ((NativeFormat<"{}", bool>::Get()), nullptr);
+
+  const ModuleHandle mh = log_->RegisterModule("Native Test").value();
+  log_->Info("Test Native {} {} {} {}"_log, int_test, long_test, pointer_test,
+             "c string");
+  log_->Info(mh, "Test Native Module {}"_log, 3.5);
+  log_->Info("Test Native Fallback {}"_log, string_test);
+  log_->SendTrace(Level::WARNING, mh, "Test Native SendTrace {}"_log, int_test);
+}
+
+TEST_F(LogTest, FormatStringTest) {
+  using namespace logging::literals;
+  const std::string runtime_format = "Test Runtime {} {}";
+
+  log_->Info(logging::RuntimeFormat(runtime_format), int_test, string_test);
+  EXPECT_THROW(log_->Info(logging::RuntimeFormat(runtime_format), int_test),
+               fmt::format_error);
+  log_->Info("Test Compiled {} {} {}"_log, int_test, string_test, long_test);
+  log_->Info("Test Compiled {:>8}"_log, int_test);
+}
+
+TEST_F(LogTest, RateLimitTest) {
+  const ModuleHandle mh = log_->RegisterModule("Rate Limit Test").value();
+  const FormatCounter counter{};
+  int evaluations = 0;
+
+  /* Every Nth call is logged, and the others are not reported */
+  static int records = 0;
+  logging::detail::trace_observer.store(
+      [](const Level /*level*/, const char* /*file*/,
+         const std::string_view /*text*/) { ++records; });
+  FormatCounter::count = 0;
+  for (int i = 0; i < 100; ++i) {
+    LOG_EVERY_N(*log_, 10, Info, "Test Every N {} {}", counter, ++evaluations);
+  }
+  logging::detail::trace_observer.store(nullptr);
+  EXPECT_EQ(FormatCounter::count.load(), 10);
+  EXPECT_EQ(evaluations, 10);
+  EXPECT_EQ(records, 10);
+
+  FormatCounter::count = 0;
+  for (int i = 0; i < 100; ++i) {
+    LOG_FIRST_N(*log_, 5, Error, mh, "Test First N {}", counter);
+  }
+  EXPECT_EQ(FormatCounter::count.load(), 5);
+
+  FormatCounter::count = 0;
+  for (int i = 0; i < 100; ++i) {
+    LOG_EVERY_T(*log_, std::chrono::hours(1), SendTrace, Level::WARNING, mh,
+                "Test Every T {}", counter);
+  }
+  EXPECT_EQ(FormatCounter::count.load(), 1);
+
+  /* The level of SendTrace is evaluated once by a call that is logged and
+   * reports the suppressed calls, and not at all by suppressed calls. */
+  int levels = 0;
+  for (int i = 0; i < 3; ++i) {
+    if (i == 2) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    }
+    LOG_EVERY_T(*log_, std::chrono::milliseconds(50), SendTrace,
+                (++levels, Level::INFO), "Test Every T Level");
+  }
+  EXPECT_EQ(levels, 2);
+
+  FormatCounter::count = 0;
+  for (int i = 0; i < 100; ++i) {
+    LOG_SAMPLED(*log_, 0.0, Critical, "Test Sampled {}", counter);
+    LOG_SAMPLED(*log_, 1.0, Critical, "Test Sampled {}", counter);
+  }
+  EXPECT_EQ(FormatCounter::count.load(), 100);
+
+  /* Suppressed messages are reported to the module of the call, which is
+   * found without evaluating the format arguments. */
+  evaluations = 0;
+  EXPECT_EQ(LOG_INTERNAL_MODULE_Warning(mh, "{}", ++evaluations).id, mh.id);
+  EXPECT_EQ(LOG_INTERNAL_MODULE_Info(7, mh, "{}", ++evaluations).id, mh.id);
+  EXPECT_EQ(LOG_INTERNAL_MODULE_Info("{}", ++evaluations).id, 0);
+  EXPECT_EQ(LOG_INTERNAL_MODULE_Info("Test").id, 0);
+  EXPECT_EQ(
+      LOG_INTERNAL_MODULE_SendTrace(Level::INFO, 7, mh, "{}", ++evaluations)
+          .id,
+      mh.id);
+  EXPECT_EQ(LOG_INTERNAL_MODULE_SendTrace(Level::INFO, "{}", ++evaluations).id,
+            0);
+  EXPECT_EQ(evaluations, 0);
+  log_->SetVerbosity(Level::ERROR);
+  for (int i = 0; i < 20; ++i) {
+    LOG_EVERY_N(*log_, 10, Warning, mh, "Test Every N Module {}", i);
+  }
+}
+
+TEST_F(LogTest, CoalesceTest) {
+  log_->RegisterThread("Test thread");
+  const ModuleHandle mh = log_->RegisterModule("Coalesce Test").value();
+  static std::vector<std::string> texts;
+  logging::detail::trace_observer.store(
+      [](const Level /*level*/, const char* /*file*/,
+         const std::string_view text) { texts.emplace_back(text); });
+  log_->SetCoalescing(mh, std::chrono::seconds(1));
+  for (int i = 0; i < 100; ++i) {
+    log_->Error(mh, "Test Coalesce {}", 1);
+  }
+  log_->Error(mh, "Test Coalesce {}", 2);
+  std::vector<std::string> expected{"Test Coalesce 1", "", "Test Coalesce 2"};
+  for (int i = 0; i < 10; ++i) {
+    log_->Warning(mh, "Test Coalesce {}", i % 2);
+    expected.push_back(fmt::format("Test Coalesce {}", i % 2));
+  }
+  log_->SetCoalescing(mh, std::chrono::nanoseconds(0));
+  log_->Error(mh, "Test Coalesce {}", 2);
+  expected.emplace_back("Test Coalesce 2");
+  logging::detail::trace_observer.store(nullptr);
+  /* The repeats are summed up once a different message arrives */
+  ASSERT_EQ(texts.size(), expected.size());
+  EXPECT_THAT(texts[1],
+              ::testing::StartsWith("Last message repeated 99 times between"));
+  texts[1].clear();
+  EXPECT_EQ(texts, expected);
+
+  log_->SetCoalescing(std::chrono::milliseconds(100));
+  log_->Info("Test Coalesce Channel");
+  log_->Info("Test Coalesce Channel");
+  log_->UnregisterThread();
+  log_->SetCoalescing(std::chrono::nanoseconds(0));
+
+  /* Once the window has passed, any message of the thread ends the streak,
+   * also one that is not coalesced. */
+  using logging::detail::repeats_pending;
+  const ModuleHandle other = log_->RegisterModule("Coalesce Other").value();
+  log_->SetCoalescing(mh, std::chrono::milliseconds(1));
+  for (int i = 0; i < 2; ++i) {
+    log_->Error(mh, "Test Coalesce Expired");
+  }
+  EXPECT_TRUE(repeats_pending);
+  log_->Error(other, "Test Coalesce Other");
+  EXPECT_TRUE(repeats_pending);
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  log_->Error(other, "Test Coalesce Other");
+  EXPECT_FALSE(repeats_pending);
+
+  /* Queued repeats are counted per producing thread. */
+  logging::StartAsync();
+  std::thread producer([&mh] {
+    for (int i = 0; i < 10; ++i) {
+      log_->Error(mh, "Test Coalesce Async");
+    }
+  });
+  for (int i = 0; i < 10; ++i) {
+    log_->Error(mh, "Test Coalesce Async");
+  }
+  producer.join();
+  logging::StopAsync();
+  log_->SetCoalescing(mh, std::chrono::nanoseconds(0));
+}
+
+TEST_F(LogTest, SplitLinesTest) {
+  using ::testing::ElementsAre;
+  EXPECT_THAT(Split("", 8), ElementsAre());
+  EXPECT_THAT(Split("one\ntwo\n\nthree\n", 8),
+              ElementsAre("one", "two", "three"));
+  EXPECT_THAT(Split("0123456789", 4), ElementsAre("0123", "4567", "89"));
+  EXPECT_THAT(Split("0123\n4567", 4), ElementsAre("0123", "4567"));
+
+  /* Long enough for the vectorized scan */
+  const std::string line(100, 'x');
+  EXPECT_THAT(Split(line + "\n" + line, 120), ElementsAre(line, line));
+  EXPECT_THAT(Split(line + line, 120),
+              ElementsAre(std::string(120, 'x'), std::string(80, 'x')));
+
+  /* Without split_lines, newlines stay inside the pieces */
+  EXPECT_THAT(Split("one\ntwo\n\nthree\n", 8, false),
+              ElementsAre("one\ntwo\n", "\nthree\n"));
+  EXPECT_THAT(Split(line + "\n" + line, 1024, false),
+              ElementsAre(line + "\n" + line));
+}
+
+TEST_F(LogTest, WrapPolicyTest) {
+  using logging::WrapMode;
+  using logging::WrapPolicy;
+  /* A channel of its own, as the policy applies to the whole channel */
+  const GELog log("wrap test");
+  EXPECT_EQ(log.GetWrapPolicy().mode, WrapMode::kWrap);
+  EXPECT_EQ(log.GetWrapPolicy().length, logging::kLineWrapLength);
+
+  const std::string long_line(logging::kLineWrapLength * 2 + 10, 'x');
+  for (const WrapPolicy policy :
+       {WrapPolicy{WrapMode::kWrap, true, 64},
+        WrapPolicy{WrapMode::kWrap, false, 0},
+        WrapPolicy{WrapMode::kNewlines, true},
+        WrapPolicy{WrapMode::kWhole, false}}) {
+    log.SetWrapPolicy(policy);
+    EXPECT_EQ(log.GetWrapPolicy().mode, policy.mode);
+    EXPECT_EQ(log.GetWrapPolicy().bare_continuations,
+              policy.bare_continuations);
+    log.Info("Test Wrap Policy\n\nsecond line\n{}\n", long_line);
+    log.Info("Test Wrap Policy {}",
+             std::string(logging::kMaxRecordLength + 10, 'y'));
+  }
+
+  logging::StartAsync();
+  log.Info("Test Wrap Policy\n{}", std::string_view("async"));
+  logging::StopAsync();
+}
+
+TEST_F(LogTest, SplitCodePointsTest) {
+  using ::testing::ElementsAre;
+  /* \u00e9 is two bytes, \u20ac three and \U0001F600 four */
+  EXPECT_THAT(Split("ab\u00e9cd", 3), ElementsAre("ab", "\u00e9c", "d"));
+  EXPECT_THAT(Split("a\u20ac\u20ac", 3),
+              ElementsAre("a", "\u20ac", "\u20ac"));
+  EXPECT_THAT(Split("a\U0001F600b", 4), ElementsAre("a", "\U0001F600", "b"));
+  /* Continuation bytes without a lead byte are cut at the wrap length */
+  EXPECT_THAT(Split("\x80\x80\x80\x80\x80", 2),
+              ElementsAre("\x80\x80", "\x80\x80", "\x80"));
+
+  std::string text;
+  for (int i = 0; i < 100; ++i) {
+    text += "\u20ac";
+  }
+  EXPECT_THAT(Split(text, 121),
+              ElementsAre(text.substr(0, 120), text.substr(120, 120),
+                          text.substr(240)));
+}
+
+TEST_F(LogTest, ChannelTest) {
+  const logging::Channel channel = logging::GetChannel("main test");
+  EXPECT_EQ(channel.trace, log_->get_trace());
+  EXPECT_EQ(GELog("main test").get_trace(), log_->get_trace());
+
+  IP7_Trace* other_thread = nullptr;
+  std::thread thread(
+      [&other_thread] { other_thread = GELog("main test").get_trace(); });
+  thread.join();
+  EXPECT_EQ(other_thread, log_->get_trace());
+
+  EXPECT_NE(GELog("Channel Test").get_trace(), log_->get_trace());
+  EXPECT_EQ(logging::Channel{}.trace, nullptr);
+
+  /* Turning logging off disables new channels, not the client */
+  absl::SetFlag(&FLAGS_logging, logging::flags::LoggingEnabled{false});
+  EXPECT_NE(Client("main").client(), nullptr);
+  const GELog disabled("Channel Test Disabled");
+  EXPECT_EQ(disabled.get_trace(), nullptr);
+  EXPECT_FALSE(disabled.IsEnabled(Level::CRITICAL));
+  absl::SetFlag(&FLAGS_logging, logging::flags::kLoggingDefault);
+  /* and they stay disabled */
+  EXPECT_EQ(GELog("Channel Test Disabled").get_trace(), nullptr);
+}
+
+TEST_F(LogTest, AutoRegisterThreadTest) {
+  IP7_Trace* registered = nullptr;
+  IP7_Trace* unregistered = log_->get_trace();
+  std::thread thread([&registered, &unregistered] {
+    pthread_setname_np(pthread_self(), "Worker 1");
+    log_->Info("Test Auto Register Thread");
+    registered = logging::detail::registered_trace;
+    EXPECT_TRUE(log_->UnregisterThread());
+    unregistered = logging::detail::registered_trace;
+    log_->Info("Test Auto Register Thread Again");
+  });
+  thread.join();
+  EXPECT_EQ(registered, log_->get_trace());
+  EXPECT_EQ(unregistered, nullptr);
+}
+
+TEST_F(LogTest, ModuleHandleTest) {
+  const ModuleHandle mh = log_->RegisterModule("Module Handle Test").value();
+  EXPECT_EQ(mh.name(), "Module Handle Test");
+  EXPECT_NE(mh.module, nullptr);
+
+  const ModuleHandle again = log_->RegisterModule("Module Handle Test").value();
+  EXPECT_EQ(again.module, mh.module);
+  EXPECT_EQ(again.id, mh.id);
+  EXPECT_EQ(again.name_id, mh.name_id);
+
+  EXPECT_NE(log_->RegisterModule("Module Handle Test 2").value().module,
+            mh.module);
+  EXPECT_EQ(ModuleHandle{}.name(), "");
+}
+
+TEST_F(LogTest, ForwardingTest) {
+  using namespace logging::literals;
+  const ModuleHandle mh = log_->RegisterModule("Forwarding Test").value();
+  const CopyCounter counter{};
+  const std::string string_arg = "string argument";
+
+  CopyCounter::copies = 0;
+  log_->Trace("Test Forwarding {} {}", counter, string_arg);
+  log_->Debug(mh, "Test Forwarding {} {}", counter, string_arg);
+  log_->Info(1, mh, "Test Forwarding {} {}", counter, string_arg);
+  log_->Warning("Test Forwarding {} {}"_log, counter, string_arg);
+  log_->Error(src_loc::current(), "Test Forwarding {}", counter);
+  log_->Critical(mh, logging::RuntimeFormat("Test Forwarding {}"), counter);
+  log_->SendTrace(Level::INFO, mh, "Test Forwarding {} {}", counter, "array");
+  LOG_EVERY_N(*log_, 1, Info, "Test Forwarding {}", counter);
+  EXPECT_EQ(CopyCounter::copies.load(), 0);
+
+  /* Queued messages own a copy of their arguments, see kCopyableArg. */
+  logging::StartAsync();
+  log_->Info("Test Forwarding {} {}", counter, "array");
+  logging::StopAsync();
+  EXPECT_EQ(CopyCounter::copies.load(), 1);
+}
+
+TEST_F(LogTest, LazyTest) {
+  /* A channel of its own, as IsAnyEnabled looks at all of its modules */
+  const GELog log("lazy test");
+  const ModuleHandle mh = log.RegisterModule("Lazy Test").value();
+  int evaluations = 0;
+  const auto expensive = logging::lazy([&evaluations] {
+    ++evaluations;
+    return std::string("expensive");
+  });
+
+  log.SetVerbosity(Level::ERROR);
+  log.SetVerbosity(mh, Level::ERROR);
+  log.Info("Test Lazy {}", expensive);
+  log.Info(mh, "Test Lazy {:>12}", expensive);
+  LOG_LAZY(log, Info, "Test Lazy {}", ++evaluations);
+  LOG_LAZY(log, SendTrace, Level::WARNING, mh, "Test Lazy {}", ++evaluations);
+  log.CAPTURE(++evaluations);
+  EXPECT_FALSE(log.IsAnyEnabled(Level::INFO));
+  EXPECT_EQ(evaluations, 0);
+
+  log.SetVerbosity(mh, Level::TRACE);
+  EXPECT_TRUE(log.IsAnyEnabled(Level::INFO));
+  log.Info("Test Lazy {}", expensive);
+  EXPECT_EQ(evaluations, 0);
+  log.Info(mh, "Test Lazy {:>12}", expensive);
+  LOG_LAZY(log, SendTrace, Level::WARNING, mh, "Test Lazy {}", ++evaluations);
+  EXPECT_EQ(evaluations, 2);
+
+  log.SetVerbosity(Level::TRACE);
+  logging::StartAsync();
+  log.Info("Test Lazy {}", expensive);
+  EXPECT_EQ(evaluations, 3);
+  logging::StopAsync();
+  EXPECT_EQ(evaluations, 3);
+}
+
+TEST_F(LogTest, FieldsTest) {
+  using logging::kv;
+  const std::string status = "not found";
+  EXPECT_EQ(Render("done", kv("latency_us", 42), kv("ok", false),
+                   kv("ratio", 0.1f), kv("status", status),
+                   kv("path", "/index.html")),
+            "done | latency_us=42 ok=false ratio=0.1 status=\"not found\" "
+            "path=/index.html");
+  FormatCounter::count = 0;
+  EXPECT_EQ(Render("done", kv("id", std::uint64_t{18446744073709551615ULL}),
+                   kv("empty", ""), kv("count", FormatCounter{})),
+            "done | id=18446744073709551615 empty=\"\" count=1");
+
+  logging::SetFieldFormat(logging::FieldFormat::kJson);
+  EXPECT_EQ(Render("say \"hi\"", kv("n", -3), kv("text", "a\nb"),
+                   kv("bad", std::numeric_limits<double>::infinity())),
+            R"({"msg":"say \"hi\"","n":-3,"text":"a\nb","bad":null})");
+  logging::SetFieldFormat(logging::FieldFormat::kText);
+
+  int evaluations = 0;
+  log_->Info("Test Fields", kv("latency_us", 42), kv("status", status));
+  log_->Info("Test Fields {}", 1, kv("lazy", logging::lazy([&evaluations] {
+                                       return ++evaluations;
+                                     })));
+  EXPECT_EQ(evaluations, 1);
+  logging::StartAsync();
+  log_->Warning("Test Fields {}", std::string("async"), kv("status", status),
+                kv("count", FormatCounter{}));
+  logging::StopAsync();
+}
+
+TEST_F(LogTest, CallSiteTest) {
+  using namespace logging::literals;
+  const ModuleHandle mh = log_->RegisterModule("Call Site Test").value();
+  const int line = __LINE__ + 1;
+  LOG_SITE(*log_, Info, "Test Site {}", 1);
+  LOG_SITE(*log_, Crit, "Test Site");
+  LOG_SITE_MODULE(*log_, Warning, mh, "Test Site {} {}"_log, 2, "module");
+
+  const auto sites = logging::GetCallSites();
+  const auto found = std::find_if(
+      sites.begin(), sites.end(), [line](const logging::CallSite* site) {
+        return site->line == static_cast<std::uint32_t>(line);
+      });
+  ASSERT_NE(found, sites.end());
+  EXPECT_STREQ((*found)->format, "Test Site {}");
+  EXPECT_EQ((*found)->level, Level::INFO);
+  EXPECT_TRUE(std::string_view((*found)->file).ends_with("Log_test.cpp"));
+  EXPECT_EQ(std::count_if(sites.begin(), sites.end(),
+                          [line](const logging::CallSite* site) {
+                            return site->line >= static_cast<std::uint32_t>(
+                                                     line) &&
+                                   site->line <= static_cast<std::uint32_t>(
+                                                     line + 2);
+                          }),
+            3);
+}
+
+TEST_F(LogTest, SiteStateTest) {
+  const ModuleHandle mh = RegisterModule("Site State Test");
+  log_->SetVerbosity(mh, Level::ERROR);
+  const auto send = [&mh] {
+    LOG_SITE_MODULE(*log_, Info, mh, "Test Site State {}", FormatCounter{});
+  };
+  const std::string location =
+      fmt::format("*Log_test.cpp:{}", __LINE__ - 3);
+
+  FormatCounter::count = 0;
+  send();
+  EXPECT_EQ(FormatCounter::count.load(), 0);
+  EXPECT_EQ(logging::SetSiteState(location, logging::SiteState::kEnabled), 1);
+  send();
+  EXPECT_EQ(FormatCounter::count.load(), 1);
+
+  log_->SetVerbosity(mh, Level::TRACE);
+  EXPECT_EQ(logging::SetSiteState(location, logging::SiteState::kDisabled),
+            1);
+  send();
+  EXPECT_EQ(FormatCounter::count.load(), 1);
+  EXPECT_EQ(logging::SetSiteState(location, logging::SiteState::kDefault), 1);
+  send();
+  EXPECT_EQ(FormatCounter::count.load(), 2);
+
+  /* The sites of CallSiteTest, matched by function name */
+  EXPECT_GE(logging::SetSiteState("*TestBody*", logging::SiteState::kDefault),
+            3);
+
+  EXPECT_EQ(logging::SetSiteState("no_such_function",
+                                  logging::SiteState::kEnabled),
+            0);
+  EXPECT_TRUE(logging::detail::GlobMatch("a*b?d", "aXXbcd"));
+  EXPECT_TRUE(logging::detail::GlobMatch("*", ""));
+  EXPECT_FALSE(logging::detail::GlobMatch("a*b?d", "aXXbd"));
+}
+
+TEST_F(LogTest, SourceNameTest) {
+  using namespace logging::literals;
+  using logging::detail::FileNames;
+  using logging::detail::FunctionNames;
+  using logging::detail::SimplifyFunctionName;
+  using logging::detail::TrimFileName;
+  static_assert(std::string_view(TrimFileName("/src/a/b.cpp", FileNames::kBase,
+                                              "")) == "b.cpp");
+  EXPECT_STREQ(TrimFileName("/src/a/b.cpp", FileNames::kRelative, "/src/"),
+               "a/b.cpp");
+  EXPECT_STREQ(TrimFileName("/other/b.cpp", FileNames::kRelative, "/src/"),
+               "/other/b.cpp");
+  EXPECT_STREQ(TrimFileName("/src/b.cpp", FileNames::kFull, "/src/"),
+               "/src/b.cpp");
+
+  constexpr std::string_view kMethod =
+      "std::vector<int, A<B> > ns::Foo<T>::Bar(int, const char*) const "
+      "[with T = std::pair<int, int>]";
+  static_assert(SimplifyFunctionName(kMethod, FunctionNames::kQualified) ==
+                "ns::Foo<T>::Bar");
+  static_assert(SimplifyFunctionName(kMethod, FunctionNames::kName) == "Bar");
+  static_assert(SimplifyFunctionName(kMethod, FunctionNames::kFull) == kMethod);
+  EXPECT_EQ(SimplifyFunctionName("int main()", FunctionNames::kName), "main");
+  EXPECT_EQ(SimplifyFunctionName("ns::Foo::operator bool() const",
+                                 FunctionNames::kName),
+            "operator bool");
+  EXPECT_EQ(SimplifyFunctionName("void ns::Foo::operator()(int) &&",
+                                 FunctionNames::kQualified),
+            "ns::Foo::operator()");
+  EXPECT_EQ(SimplifyFunctionName("virtual void A::TestBody()::<lambda()>",
+                                 FunctionNames::kName),
+            "TestBody()::<lambda()>");
+
+  /* Default arguments take the location of the caller */
+  const auto where = [](const logging::CustomSourceLocation loc =
+                            logging::CustomSourceLocation::current()) {
+    return loc;
+  };
+  const logging::CustomSourceLocation loc = where();
+  EXPECT_EQ(loc.line(), static_cast<std::uint32_t>(__LINE__ - 1));
+  EXPECT_STREQ(loc.function_name(), "TestBody");
+  EXPECT_TRUE(std::string_view(loc.file_name()).ends_with("Log_test.cpp"));
+
+  LOG_SITE(*log_, Info, "Test Source Name");
+  const auto sites = logging::GetCallSites();
+  EXPECT_TRUE(std::any_of(sites.begin(), sites.end(),
+                          [](const logging::CallSite* site) {
+                            return std::string_view(site->function)
+                                           .find("TestBody") !=
+                                       std::string_view::npos &&
+                                   std::string_view(site->format) ==
+                                       "Test Source Name";
+                          }));
+
+  /* Native and formatted messages send the same trimmed file name */
+  static std::vector<std::string> files;
+  logging::detail::trace_observer.store(
+      [](const Level /*level*/, const char* file,
+         const std::string_view /*text*/) { files.emplace_back(file); });
+  log_->Info("Test Source Native {}"_log, int_test);
+  log_->Info("Test Source Formatted {}", int_test);
+  logging::detail::trace_observer.store(nullptr);
+  ASSERT_EQ(files.size(), 2u);
+  EXPECT_EQ(files[0], TrimFileName(__FILE__));
+  EXPECT_EQ(files[1], files[0]);
+}
+
+TEST_F(LogTest, ScopedContextTest) {
+  using logging::kv;
+  using logging::ScopedContext;
+  EXPECT_EQ(Render("done"), "done");
+  {
+    const ScopedContext request("req", 42);
+    {
+      const ScopedContext tenant("tenant", std::string("acme corp"));
+      EXPECT_EQ(Render("done", kv("ok", true)),
+                "done | req=42 tenant=\"acme corp\" ok=true");
+      std::thread([] { EXPECT_EQ(Render("other"), "other"); }).join();
+    }
+    EXPECT_EQ(Render("done"), "done | req=42");
+
+    /* Entries that do not fit are dropped, and popped without harm */
+    const std::string large(logging::detail::kContextSize, 'x');
+    {
+      const ScopedContext dropped("large", large);
+      EXPECT_EQ(Render("done"), "done | req=42");
+    }
+    {
+      const ScopedContext dropped("text", Repeat{'x', 600});
+      EXPECT_EQ(Render("done"), "done | req=42");
+    }
+    /* Entries larger than the inline storage of a FieldBuffer are kept */
+    const std::string medium(300, 'y');
+    {
+      const ScopedContext kept("medium", medium);
+      EXPECT_EQ(Render("done"), "done | req=42 medium=" + medium);
+    }
+    log_->Info("Test Context {}", 1);
+    logging::StartAsync();
+    log_->Info("Test Context {}", std::string("async"));
+    logging::StopAsync();
+  }
+  EXPECT_EQ(Render("done"), "done");
+  EXPECT_EQ(logging::detail::context.size, 0u);
+}
+
+TEST_F(LogTest, BatchTest) {
+  const ModuleHandle mh = RegisterModule("Batch Test");
+  log_->SetVerbosity(mh, Level::ERROR);
+  FormatCounter::count = 0;
+  {
+    logging::Batch batch(*log_, Level::INFO, mh);
+    EXPECT_FALSE(batch.enabled());
+    batch.Add("Test Batch {}", FormatCounter{});
+    EXPECT_EQ(batch.size(), 0u);
+  }
+  EXPECT_EQ(FormatCounter::count.load(), 0);
+
+  logging::Batch batch(*log_, Level::ERROR, mh);
+  for (int i = 0; i < 3; ++i) {
+    batch.Add("Test Batch {} {}", i, FormatCounter{});
+  }
+  batch.Add("Test Batch", logging::kv("item", 3));
+  EXPECT_EQ(batch.size(), 4u);
+  EXPECT_EQ(FormatCounter::count.load(), 3);
+  batch.Submit();
+  EXPECT_EQ(batch.size(), 0u);
+
+  logging::StartAsync();
+  batch.Add("Test Batch {}", std::string("async"));
+  batch.Submit();
+  /* Batches larger than a queue slot still take one slot */
+  for (int i = 0; i < 20; ++i) {
+    batch.Add("Test Batch {} {}", i, std::string(20, 'x'));
+  }
+  batch.Submit();
+  logging::StopAsync();
+  EXPECT_EQ(logging::GetAsyncStats().queued, 2);
+}
+
+TEST_F(LogTest, BacktraceTest) {
+  log_->SetVerbosity(Level::WARNING);
+  logging::EnableBacktrace(logging::BacktraceOptions{4, Level::ERROR});
+  FormatCounter::count = 0;
+  for (int i = 0; i < 6; ++i) {
+    log_->Info("Test Backtrace {} {}", i, FormatCounter{});
+  }
+  log_->Trace("Test Backtrace {}",
+              logging::lazy([] { return FormatCounter{}; }));
+  log_->Warning("Test Backtrace warning");
+  /* Suppressed messages are copied, not formatted */
+  EXPECT_EQ(FormatCounter::count.load(), 0);
+
+  log_->Error("Test Backtrace error");
+  /* Only the last four are kept */
+  EXPECT_EQ(FormatCounter::count.load(), 4);
+  log_->Error("Test Backtrace error");
+  EXPECT_EQ(FormatCounter::count.load(), 4);
+
+
+  /* Arguments that refer to memory of the caller are not remembered */
+  using logging::detail::backtrace::kRememberable;
+  static_assert(kRememberable<int, std::string, logging::Field<View>>);
+  static_assert(!kRememberable<int, View>);
+  {
+    const int target = 7;
+    log_->Info("Test Backtrace {}", View{&target});
+  }
+  View::dangling = true;
+  log_->Error("Test Backtrace error");
+  View::dangling = false;
+  EXPECT_EQ(View::dangling_reads.load(), 0);
+
+  logging::DisableBacktrace();
+  log_->Info("Test Backtrace {}", FormatCounter{});
+  log_->Error("Test Backtrace error");
+  EXPECT_EQ(FormatCounter::count.load(), 4);
+}
+
+TEST_F(LogTest, RedactionTest) {
+  using logging::RedactionKind;
+  const std::string stars(64, '*');
+  logging::SetRedactionPatterns({{RedactionKind::kLiteral, "hunter2"},
+                                 {RedactionKind::kPrefix, "Bearer "},
+                                 {RedactionKind::kEmail, ""},
+                                 {RedactionKind::kCardNumber, ""}});
+  EXPECT_EQ(Redacted("pass hunter2, hunter2"), "pass *******, *******");
+  EXPECT_EQ(Redacted("Authorization: Bearer abc.DEF-123 ok"),
+            "Authorization: Bearer " + stars.substr(0, 11) + " ok");
+  EXPECT_EQ(Redacted("Bearer "), "Bearer ");
+  EXPECT_EQ(Redacted("mail jane.doe+x@example.co.uk."),
+            "mail " + stars.substr(0, 24) + ".");
+  EXPECT_EQ(Redacted("a@b @x.com user@.com"), "a@b @x.com user@.com");
+  EXPECT_EQ(Redacted("card 4111 1111 1111 1111 end"),
+            "card **** **** **** 1111 end");
+  EXPECT_EQ(Redacted("card 4111-1111-1111-1112"), "card 4111-1111-1111-1112");
+  EXPECT_EQ(Redacted("id4111111111111111 12:30:45 12345"),
+            "id4111111111111111 12:30:45 12345");
+
+  /* Long enough for the vectorized scan */
+  const std::string padding(100, '.');
+  EXPECT_EQ(Redacted(padding + "hunter2" + padding + "4111111111111111"),
+            padding + "*******" + padding + "************1111");
+
+  /* More leading bytes than are compared at a time */
+  logging::SetRedactionPatterns(
+      {{RedactionKind::kLiteral, "a1"}, {RedactionKind::kLiteral, "b2"},
+       {RedactionKind::kLiteral, "c3"}, {RedactionKind::kLiteral, "d4"},
+       {RedactionKind::kLiteral, "e5"}, {RedactionKind::kLiteral, "f6"},
+       {RedactionKind::kLiteral, "g7"}, {RedactionKind::kLiteral, "h8"},
+       {RedactionKind::kLiteral, "i9"}});
+  EXPECT_EQ(Redacted(padding + "i9 a1"), padding + "** **");
+
+  /* A channel of its own, as redaction is set per channel */
+  const GELog log("redaction test");
+  logging::SetRedactionPatterns({{RedactionKind::kPrefix, "token="}});
+  log.SetRedaction(Level::WARNING);
+  log.Info("Test Redaction token={}", 42);
+  log.Warning("Test Redaction token={}", 42);
+  log.Warning("Test Redaction", logging::kv("auth", "token=secret"));
+  logging::StartAsync();
+  log.Warning("Test Redaction token={}", std::string("secret"));
+  logging::StopAsync();
+  log.ClearRedaction();
+
+  logging::SetRedactionPatterns({});
+  EXPECT_EQ(Redacted("token=secret"), "token=secret");
 }